@@ -19,6 +19,10 @@ struct LinkedList {
 
 struct AppendableDataStore {
   LinkedList *lastNode;
+  /* Nodes kept by AppendableDataStoreReset, these are used before
+     allocating new nodes. Only their next pointers are used, they aren't
+     circular. */
+  LinkedList *spareNodes;
   /* This size of the dataType to be stored in the Linked List. */
   size_t dataTypeSize;
   /* The number of elements of dataType that each node can store. */
@@ -38,23 +42,32 @@ struct AppendableDataStore {
 LinkedList *LinkedListCreate (unsigned count, size_t typeSize);
 
 /* Frees all of the data in the linked list. For use by the AppendableDataStore. */
-void LinkedListFree ();
+void LinkedListFree (LinkedList *list);
 
 AppendableDataStore *AppendableDataStoreCreate (unsigned count, size_t typeSize) {
-  AppendableDataStore *result = malloc (sizeof (AppendableDataStore));
+  AppendableDataStore *result = calloc (1, sizeof (AppendableDataStore));
   result->dataTypeSize = typeSize;
   result->nodeCapacity = count;
-  result->nodeCount = 0;
-  result->lastNode = NULL;
   return result;
 }
 
+/* Gets an empty node, from the spare nodes if there are any. */
+static LinkedList *AppendableDataStoreNewNode (AppendableDataStore *manager) {
+  LinkedList *node = manager->spareNodes;
+  if (!node)
+    return LinkedListCreate (manager->nodeCapacity, manager->dataTypeSize);
+
+  manager->spareNodes = node->next;
+  node->dataCount = 0;
+  node->next = node;
+  return node;
+}
+
 void AppendableDataStoreAddData (AppendableDataStore *manager,
                                  void *data, unsigned count) {
   manager->dataCount += count;
   if (!manager->lastNode) {
-    manager->lastNode = LinkedListCreate (manager->nodeCapacity,
-                                          manager->dataTypeSize);
+    manager->lastNode = AppendableDataStoreNewNode (manager);
     ++manager->nodeCount;
   }
   
@@ -75,8 +88,9 @@ void AppendableDataStoreAddData (AppendableDataStore *manager,
             data, dataToCopySize);
     
     data += dataToCopySize;
+    remainingDataToCopy -= dataToCopyCount;
     currentNode->dataCount = manager->nodeCapacity;
-    LinkedList *newNode = LinkedListCreate (manager->nodeCapacity, manager->dataTypeSize);
+    LinkedList *newNode = AppendableDataStoreNewNode (manager);
     newNode->next = currentNode->next;
     currentNode->next = newNode;
     ++manager->nodeCount;
@@ -122,7 +136,16 @@ void *AppendableDataStoreGetData (AppendableDataStore *manager) {
 }
 
 bool AppendableDataStoreNext (AppendableDataStore *manager, void *value) {
-  if (manager->enumerationLocation == manager->dataCount) {
+  if (!manager->lastNode)
+    return false;
+
+  if (!manager->enumerationNode) {
+    /* Start from the first node, which is the one after the last node. */
+    manager->enumerationNode = manager->lastNode->next;
+    manager->enumerationLocation = 0;
+  }
+
+  while (manager->enumerationLocation == manager->enumerationNode->dataCount) {
     if (manager->enumerationNode == manager->lastNode)
       return false;
 
@@ -131,19 +154,90 @@ bool AppendableDataStoreNext (AppendableDataStore *manager, void *value) {
   }
 
   memcpy (value,
-          manager->enumerationNode + manager->enumerationLocation * manager->dataTypeSize,
+          (char *)manager->enumerationNode->data
+          + manager->enumerationLocation * manager->dataTypeSize,
           manager->dataTypeSize);
+  ++manager->enumerationLocation;
   return true;
 }
 
+void AppendableDataStoreResetEnumeration (AppendableDataStore *manager) {
+  manager->enumerationNode = NULL;
+  manager->enumerationLocation = 0;
+}
+
+size_t AppendableDataStoreDataTypeSize (AppendableDataStore *manager) {
+  return manager->dataTypeSize;
+}
+
+void AppendableDataStoreReset (AppendableDataStore *manager,
+                               unsigned maxRetainedNodes) {
+  /* Keep the first maxRetainedNodes spare nodes from an earlier reset. */
+  unsigned spareCount = 0;
+  for (LinkedList **spare = &manager->spareNodes; *spare; ) {
+    if (spareCount < maxRetainedNodes) {
+      ++spareCount;
+      spare = &(*spare)->next;
+    } else {
+      LinkedList *node = *spare;
+      *spare = node->next;
+      free (node->data);
+      free (node);
+    }
+  }
+
+  if (manager->lastNode) {
+    /* Break the circle so the nodes can be walked from the first one. */
+    LinkedList *node = manager->lastNode->next;
+    manager->lastNode->next = NULL;
+    while (node) {
+      LinkedList *next = node->next;
+      if (spareCount < maxRetainedNodes) {
+        node->next = manager->spareNodes;
+        manager->spareNodes = node;
+        ++spareCount;
+      } else {
+        free (node->data);
+        free (node);
+      }
+
+      node = next;
+    }
+  }
+
+  manager->lastNode = NULL;
+  manager->nodeCount = 0;
+  manager->dataCount = 0;
+  manager->enumerationNode = NULL;
+  manager->enumerationLocation = 0;
+}
+
+size_t AppendableDataStoreCapacity (AppendableDataStore *manager) {
+  size_t nodeCount = manager->nodeCount;
+  for (LinkedList *node = manager->spareNodes; node; node = node->next)
+    ++nodeCount;
+
+  return nodeCount * manager->nodeCapacity * manager->dataTypeSize;
+}
+
 void AppendableDataStoreFree (AppendableDataStore *manager) {
-  LinkedListFree (manager->lastNode);
+  if (manager->lastNode)
+    LinkedListFree (manager->lastNode);
+
+  LinkedList *node = manager->spareNodes;
+  while (node) {
+    LinkedList *next = node->next;
+    free (node->data);
+    free (node);
+    node = next;
+  }
+
   free (manager);
 }
 
 LinkedList *LinkedListCreate (unsigned count, size_t typeSize) {
   LinkedList *node = malloc (sizeof (LinkedList));
-  node->data = malloc (count * sizeof (typeSize));
+  node->data = malloc (count * typeSize);
   node->dataCount = 0;
   node->next = node;
   return node;
@@ -153,6 +247,7 @@ void LinkedListFree (LinkedList *list) {
   LinkedList *next = list;
   do {
     LinkedList *nextNext = next->next;
+    free (next->data);
     free (next);
     next = nextNext;
   } while (next != list);
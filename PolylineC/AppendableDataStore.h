@@ -2,6 +2,7 @@
 #define googlePolylineTest_AppendableDataStore_h
 
 #include <stdbool.h>
+#include <stddef.h>
 
 struct AppendableDataStore;
 typedef struct AppendableDataStore AppendableDataStore;
@@ -22,6 +23,9 @@ void AppendableDataStoreAddData (AppendableDataStore *store,
 /* returns the total size of all of the data contained in the linked list. */
 size_t AppendableDataStoreDataSize (AppendableDataStore *store);
 
+/* returns the dataTypeSize the store was created with. */
+size_t AppendableDataStoreDataTypeSize (AppendableDataStore *store);
+
 /* Copies all of the data from the linked list into result. result must
    have at least enough room for all of the data in the linked list. */
 void AppendableDataStoreCollapseDataIntoResult (AppendableDataStore *store,
@@ -46,7 +50,18 @@ bool AppendableDataStoreNext (AppendableDataStore *store, void *value);
 /* Resets the enumeration. i.e. AppendableDataStoreNext will now return
    the first value stored in the dataStore again. */
 void AppendableDataStoreResetEnumeration (AppendableDataStore *store);
-  
+
+/* Removes all of the data from the store so that it can be reused. Up to
+   maxRetainedNodes of the nodes are kept and filled before any new nodes
+   are allocated, the rest are freed. */
+void AppendableDataStoreReset (AppendableDataStore *store,
+                               unsigned maxRetainedNodes);
+
+/* returns the bytes of node storage the store holds, including the nodes
+   kept by AppendableDataStoreReset. */
+size_t AppendableDataStoreCapacity (AppendableDataStore *store);
+
+
 void AppendableDataStoreFree (AppendableDataStore *store);
 
 #endif
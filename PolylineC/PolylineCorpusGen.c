@@ -0,0 +1,258 @@
+/* PolylineCorpusGen makes files of made up GPS traces for testing and
+   tuning the polyline code. Each trace is a random walk with a
+   configurable number of points, step size, GPS jitter, hemisphere and
+   chance of large jumps (e.g. a gap in the recording). The same seed
+   always gives the same corpus. */
+
+/* Needed for getopt when compiling with -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "polylineFunctions.h"
+
+/* M_PI isn't part of C99. */
+#define CORPUS_PI 3.14159265358979323846
+
+/* Metres per degree of latitude. */
+static const double metresPerDegree = 6371008.8 * CORPUS_PI / 180.0;
+
+typedef struct CorpusOptions {
+  unsigned polylineCount;
+  unsigned minPoints;
+  unsigned maxPoints;
+  /* The average distance between points, in metres. */
+  double stepSize;
+  /* The standard deviation of the GPS noise added to each point, in
+     metres. */
+  double jitter;
+  /* The chance of each step being a jump of 1 to 100km. */
+  double jumpProbability;
+  /* -1, 0 or 1 for the southern, either or northern hemisphere and the
+     western, either or eastern hemisphere. */
+  int latitudeSign;
+  int longitudeSign;
+  bool binary;
+  uint64_t seed;
+} CorpusOptions;
+
+/* xorshift64*, so the corpus doesn't depend on the platform's rand (). */
+static uint64_t randomState;
+
+static inline uint64_t nextRandom ()
+{
+  randomState ^= randomState >> 12;
+  randomState ^= randomState << 25;
+  randomState ^= randomState >> 27;
+  return randomState * 2685821657736338717ULL;
+}
+
+/* Returns a value in [0, 1). */
+static inline double uniformRandom ()
+{
+  return (nextRandom () >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double normalRandom (double standardDeviation)
+{
+  /* Box-Muller, 1 - uniformRandom () is never 0. */
+  double u = 1.0 - uniformRandom ();
+  double v = uniformRandom ();
+  return standardDeviation * sqrt (-2.0 * log (u)) * cos (2.0 * CORPUS_PI * v);
+}
+
+static double randomInRange (double min, double max)
+{
+  return min + (max - min) * uniformRandom ();
+}
+
+/* Picks a start point in the hemispheres asked for, avoiding the poles. */
+static Coordinate randomStart (const CorpusOptions *options)
+{
+  Coordinate start;
+  start.latitude = randomInRange (options->latitudeSign > 0 ? 0 : -70,
+                                  options->latitudeSign < 0 ? 0 : 70);
+  start.longitude = randomInRange (options->longitudeSign > 0 ? 0 : -180,
+                                   options->longitudeSign < 0 ? 0 : 180);
+  return start;
+}
+
+/* Moves coord distance metres in the direction heading (radians
+   clockwise from north). */
+static void move (Coordinate *coord, double heading, double distance)
+{
+  coord->latitude += distance * cos (heading) / metresPerDegree;
+  coord->longitude += distance * sin (heading)
+                      / (metresPerDegree * cos (coord->latitude * CORPUS_PI / 180.0));
+
+  if (coord->latitude > 85.0)
+    coord->latitude = 85.0;
+  else if (coord->latitude < -85.0)
+    coord->latitude = -85.0;
+
+  if (coord->longitude > 180.0)
+    coord->longitude -= 360.0;
+  else if (coord->longitude < -180.0)
+    coord->longitude += 360.0;
+}
+
+static void generateTrace (const CorpusOptions *options,
+                           Coordinate *coords, unsigned pointCount)
+{
+  Coordinate position = randomStart (options);
+  double heading = randomInRange (0, 2 * CORPUS_PI);
+
+  for (unsigned i = 0; i < pointCount; ++i) {
+    Coordinate reported = position;
+    if (options->jitter > 0) {
+      move (&reported, randomInRange (0, 2 * CORPUS_PI),
+            fabs (normalRandom (options->jitter)));
+    }
+
+    coords[i] = reported;
+
+    if (options->jumpProbability > 0
+        && uniformRandom () < options->jumpProbability) {
+      move (&position, randomInRange (0, 2 * CORPUS_PI),
+            randomInRange (1000, 100000));
+    } else {
+      heading += normalRandom (0.3);
+      move (&position, heading,
+            options->stepSize * randomInRange (0.5, 1.5));
+    }
+  }
+}
+
+static void usage ()
+{
+  printf ("PolylineCorpusGen: makes a corpus of random GPS traces.\n\n"
+          "PolylineCorpusGen [-npsjJHrbo]\n"
+          "-n <Count> The number of traces, default 1000.\n"
+          "-p <Min>[,<Max>] The number of points in each trace, default "
+          "50,500.\n"
+          "-s <Metres> The average distance between points, default 20.\n"
+          "-j <Metres> The standard deviation of the noise added to each "
+          "point, default 3.\n"
+          "-J <Probability> The chance of each step being a jump of 1 to "
+          "100km, default 0.\n"
+          "-H <N|S|E|W|NE|NW|SE|SW> Only make traces in these hemispheres, "
+          "default anywhere.\n"
+          "-r <Seed> The random seed, default 1.\n"
+          "-b Writes binary rather than text, see below.\n"
+          "-o <FileName> Writes to a file instead of standard out.\n\n"
+          "The text format is one encoded polyline per line. The binary "
+          "format is, for each trace, its point count as a uint32_t followed "
+          "by that many latitude, longitude pairs of doubles, all in the "
+          "machine's byte order.\n");
+
+  exit (1);
+}
+
+static void parseHemisphere (const char *arg, CorpusOptions *options)
+{
+  for (; *arg; ++arg) {
+    switch (*arg) {
+    case 'N': case 'n': options->latitudeSign = 1; break;
+    case 'S': case 's': options->latitudeSign = -1; break;
+    case 'E': case 'e': options->longitudeSign = 1; break;
+    case 'W': case 'w': options->longitudeSign = -1; break;
+    default:
+      fprintf (stderr, "Unknown hemisphere %c\n", *arg);
+      usage ();
+    }
+  }
+}
+
+int main (int argc, char **argv)
+{
+  CorpusOptions options = { 1000, 50, 500, 20.0, 3.0, 0.0, 0, 0, false, 1 };
+  FILE *output = stdout;
+  int ch;
+
+  while ((ch = getopt (argc, argv, "n:p:s:j:J:H:r:bo:")) != -1) {
+    switch (ch) {
+    case 'n':
+      options.polylineCount = (unsigned)strtoul (optarg, NULL, 10);
+      break;
+    case 'p': {
+      char *end;
+      options.minPoints = (unsigned)strtoul (optarg, &end, 10);
+      options.maxPoints = *end == ',' ? (unsigned)strtoul (end + 1, NULL, 10)
+                                      : options.minPoints;
+      break;
+    }
+    case 's':
+      options.stepSize = strtod (optarg, NULL);
+      break;
+    case 'j':
+      options.jitter = strtod (optarg, NULL);
+      break;
+    case 'J':
+      options.jumpProbability = strtod (optarg, NULL);
+      break;
+    case 'H':
+      parseHemisphere (optarg, &options);
+      break;
+    case 'r':
+      options.seed = strtoull (optarg, NULL, 10);
+      break;
+    case 'b':
+      options.binary = true;
+      break;
+    case 'o':
+      output = fopen (optarg, options.binary ? "wb" : "w");
+      if (!output) {
+        fprintf (stderr, "Couldn't open output file.\n");
+        exit (1);
+      }
+      break;
+    default:
+      usage ();
+    }
+  }
+
+  if (!options.minPoints || options.maxPoints < options.minPoints) {
+    fprintf (stderr, "-p needs 0 < Min <= Max\n");
+    usage ();
+  }
+
+  /* xorshift can't have a zero state. */
+  randomState = options.seed * 0x9E3779B97F4A7C15ULL + 1;
+  Coordinate *coords = malloc (options.maxPoints * sizeof (Coordinate));
+  if (!coords) {
+    fprintf (stderr, "Couldn't allocate %u points.\n", options.maxPoints);
+    exit (1);
+  }
+
+  for (unsigned i = 0; i < options.polylineCount; ++i) {
+    unsigned pointCount = options.minPoints
+                          + (unsigned)(nextRandom ()
+                                       % (options.maxPoints - options.minPoints + 1));
+    generateTrace (&options, coords, pointCount);
+
+    if (options.binary) {
+      uint32_t count = pointCount;
+      fwrite (&count, sizeof (count), 1, output);
+      fwrite (coords, sizeof (Coordinate), pointCount, output);
+    } else {
+      char *encoded = copyEncodedLocationsString (coords, pointCount);
+      if (!encoded) {
+        fprintf (stderr, "Couldn't allocate the encoded polyline.\n");
+        exit (1);
+      }
+
+      fprintf (output, "%s\n", encoded);
+      free (encoded);
+    }
+  }
+
+  free (coords);
+  fclose (output);
+  return 0;
+}
@@ -0,0 +1,229 @@
+/* PolylineEncodeBench times encoding on a dense trace, built by repeating
+   ExampleCoords, and on a noisy trace whose differences are often too big
+   for the encode table in polylineFunctions.c. `make bench` runs it with
+   and without the table so the two can be compared on this machine. */
+
+/* Needed for getopt and clock_gettime when compiling with -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "polylineFunctions.h"
+
+typedef struct Trace {
+  const char *name;
+  size_t count;
+  Coordinate *coords;
+  /* The same coordinates as E5 latitude, longitude pairs. */
+  int32_t *latLngs;
+} Trace;
+
+static uint64_t now ()
+{
+  struct timespec time;
+  clock_gettime (CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000u + time.tv_nsec;
+}
+
+static Trace createTrace (const char *name, size_t count)
+{
+  Trace trace = { name, count, malloc (count * sizeof (Coordinate)),
+                  malloc (count * 2 * sizeof (int32_t)) };
+  if (!trace.coords || !trace.latLngs) {
+    fprintf (stderr, "Couldn't allocate %zu coordinates\n", count);
+    exit (1);
+  }
+
+  return trace;
+}
+
+static void setIntValues (Trace *trace)
+{
+  for (size_t i = 0; i < trace->count; ++i) {
+    trace->latLngs[2 * i] = (int32_t)round (trace->coords[i].latitude * 1e5);
+    trace->latLngs[2 * i + 1] = (int32_t)round (trace->coords[i].longitude * 1e5);
+  }
+}
+
+/* Repeats the "lat, lng" lines in fileName until there are count
+   coordinates, going back and forth along them so the differences
+   between neighbouring coordinates are all ones from the file. */
+static Trace loadDenseTrace (const char *fileName, size_t count)
+{
+  FILE *file = fopen (fileName, "r");
+  if (!file) {
+    fprintf (stderr, "Couldn't open %s\n", fileName);
+    exit (1);
+  }
+
+  size_t lineCount = 0, capacity = 1024;
+  Coordinate *lines = malloc (capacity * sizeof (Coordinate));
+  Coordinate coord;
+  while (fscanf (file, "%lf, %lf", &coord.latitude, &coord.longitude) == 2) {
+    if (lineCount == capacity) {
+      capacity *= 2;
+      lines = realloc (lines, capacity * sizeof (Coordinate));
+    }
+
+    lines[lineCount++] = coord;
+  }
+
+  fclose (file);
+  if (lineCount < 2) {
+    fprintf (stderr, "%s needs at least two coordinates\n", fileName);
+    exit (1);
+  }
+
+  Trace trace = createTrace ("dense", count);
+  size_t period = 2 * (lineCount - 1);
+  for (size_t i = 0; i < count; ++i) {
+    size_t position = i % period;
+    trace.coords[i] = lines[position < lineCount ? position : period - position];
+  }
+
+  free (lines);
+  setIntValues (&trace);
+  return trace;
+}
+
+/* A random walk with uniform noise of up to noise degrees either way
+   added to every coordinate, like a poor GPS fix. */
+static Trace makeNoisyTrace (size_t count, double noise, unsigned seed)
+{
+  Trace trace = createTrace ("noisy", count);
+  srand (seed);
+  double latitude = 51.5, longitude = -0.1;
+  for (size_t i = 0; i < count; ++i) {
+    latitude += 0.0001 * ((double)rand () / RAND_MAX - 0.5);
+    longitude += 0.0001 * ((double)rand () / RAND_MAX - 0.5);
+    trace.coords[i].latitude = latitude
+                               + noise * (2.0 * rand () / RAND_MAX - 1.0);
+    trace.coords[i].longitude = longitude
+                                + noise * (2.0 * rand () / RAND_MAX - 1.0);
+  }
+
+  setIntValues (&trace);
+  return trace;
+}
+
+/* The share of the values that encodeIntValue can take from its table,
+   i.e. whose zig-zagged difference is below 1024. */
+static double smallDifferenceShare (const Trace *trace)
+{
+  size_t small = 0;
+  int32_t previous[2] = { 0, 0 };
+  for (size_t i = 0; i < 2 * trace->count; ++i) {
+    int64_t difference = (int64_t)trace->latLngs[i] - previous[i % 2];
+    previous[i % 2] = trace->latLngs[i];
+    if (difference >= -512 && difference < 512)
+      ++small;
+  }
+
+  return (double)small / (2 * trace->count);
+}
+
+/* Encodes the trace repeats times using the double or the fixed point
+   entry point and prints the fastest run. */
+static void timeEncoding (const Trace *trace, bool fixedPoint,
+                          unsigned repeats)
+{
+  uint64_t best = UINT64_MAX;
+  size_t length = 0;
+  for (unsigned i = 0; i < repeats; ++i) {
+    uint64_t start = now ();
+    char *encoded = fixedPoint
+                    ? copyEncodedFixedPointLocationsString (trace->latLngs,
+                                                            trace->count,
+                                                            100000)
+                    : copyEncodedLocationsString (trace->coords, trace->count);
+    uint64_t time = now () - start;
+    if (!encoded) {
+      fprintf (stderr, "Couldn't allocate the encoded string\n");
+      exit (1);
+    }
+
+    length = strlen (encoded);
+    free (encoded);
+    if (time < best)
+      best = time;
+  }
+
+  printf ("%-6s %-12s %6.2f ns/coord %8.1f MB/s  (%.1f chars/coord)\n",
+          trace->name, fixedPoint ? "fixed point" : "double",
+          (double)best / trace->count, length * 1e3 / best,
+          (double)length / trace->count);
+}
+
+static void usage ()
+{
+  printf ("PolylineEncodeBench [-incrs?]\n"
+          "  -i <File>     The \"lat, lng\" trace repeated for the dense data\n"
+          "                (default ExampleCoords).\n"
+          "  -n <Count>    The number of coordinates in each trace\n"
+          "                (default 1000000).\n"
+          "  -c <Degrees>  The noise added to each noisy coordinate\n"
+          "                (default 0.01).\n"
+          "  -r <Repeats>  The number of times each encoding is timed, the\n"
+          "                fastest is printed (default 10).\n"
+          "  -s <Seed>     The seed for the noisy data (default 1).\n"
+          "  -?            Print this message.\n");
+}
+
+int main (int argc, char **argv)
+{
+  const char *fileName = "ExampleCoords";
+  size_t count = 1000000;
+  double noise = 0.01;
+  unsigned repeats = 10;
+  unsigned seed = 1;
+
+  int ch;
+  while ((ch = getopt (argc, argv, "i:n:c:r:s:?")) != -1) {
+    switch (ch) {
+      case 'i':
+        fileName = optarg;
+        break;
+      case 'n':
+        count = strtoul (optarg, NULL, 10);
+        break;
+      case 'c':
+        noise = atof (optarg);
+        break;
+      case 'r':
+        repeats = (unsigned)strtoul (optarg, NULL, 10);
+        break;
+      case 's':
+        seed = (unsigned)strtoul (optarg, NULL, 10);
+        break;
+      case '?':
+      default:
+        usage ();
+        return 1;
+    }
+  }
+
+  if (!count || !repeats) {
+    usage ();
+    return 1;
+  }
+
+  Trace traces[2] = { loadDenseTrace (fileName, count),
+                      makeNoisyTrace (count, noise, seed) };
+  for (unsigned i = 0; i < 2; ++i) {
+    printf ("%-6s %.1f%% of differences are within 512\n", traces[i].name,
+            100 * smallDifferenceShare (&traces[i]));
+    timeEncoding (&traces[i], false, repeats);
+    timeEncoding (&traces[i], true, repeats);
+    free (traces[i].coords);
+    free (traces[i].latLngs);
+  }
+
+  return 0;
+}
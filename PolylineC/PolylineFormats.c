@@ -0,0 +1,945 @@
+//
+//  PolylineFormats.c
+//  PolylineTool
+//
+
+/* Needed for mmap, fileno and ftello when compiling with -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "PolylineFormats.h"
+#include "polylineFunctions.h"
+#include "polylineVarint.h"
+
+/* Output is collected in a buffer this big before it's written. */
+static const size_t outputBufferSize = 1 << 20;
+
+/* The most characters written for a single point of GeoJSON. */
+static const size_t maxGeoJSONPointLength = 64;
+
+/* Nesting deeper than this in the input is assumed to be malicious. */
+static const unsigned maxNestingDepth = 256;
+
+#define WKB_POINT 1
+#define WKB_LINESTRING 2
+#define WKB_POLYGON 3
+#define WKB_MULTIPOINT 4
+#define WKB_MULTILINESTRING 5
+#define WKB_MULTIPOLYGON 6
+#define WKB_GEOMETRYCOLLECTION 7
+
+/* EWKB keeps these flags in the top bits of the geometry type. */
+#define EWKB_Z_FLAG 0x80000000u
+#define EWKB_M_FLAG 0x40000000u
+#define EWKB_SRID_FLAG 0x20000000u
+
+/* The SRID of WGS84 latitudes and longitudes. */
+#define WGS84_SRID 4326
+
+static void fail (const char *message)
+{
+  fprintf (stderr, "%s\n", message);
+  exit (1);
+}
+
+/* realloc, but there's nothing to be done without the memory. */
+static void *reallocOrFail (void *data, size_t size)
+{
+  data = realloc (data, size);
+  if (!data)
+    fail ("Couldn't allocate memory.");
+
+  return data;
+}
+
+typedef struct Input {
+  char *data;
+  size_t length;
+  bool mapped;
+} Input;
+
+/* Gets all of instream into memory. A regular file is mapped, so it's
+   parsed straight from the page cache rather than being copied. It's
+   only mapped if its length isn't a multiple of the page size, then the
+   rest of the last page is zeros and the data is NUL terminated like a
+   buffer that was read in, which strtod relies on. The mapping is
+   private and writable so hex can be turned into bytes in place. */
+static Input readInput (FILE *instream)
+{
+  Input input = { NULL, 0, false };
+  struct stat status;
+  int fd = fileno (instream);
+  long pageSize = sysconf (_SC_PAGESIZE);
+
+  if (fd != -1 && !fstat (fd, &status) && S_ISREG (status.st_mode)
+      && status.st_size > 0 && ftello (instream) == 0 && pageSize > 0
+      && status.st_size % pageSize) {
+    void *data = mmap (NULL, status.st_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      input.data = data;
+      input.length = status.st_size;
+      input.mapped = true;
+      return input;
+    }
+  }
+
+  size_t capacity = outputBufferSize;
+  input.data = reallocOrFail (NULL, capacity + 1);
+  size_t readCount;
+  while ((readCount = fread (input.data + input.length, 1,
+                             capacity - input.length, instream))) {
+    input.length += readCount;
+    if (input.length == capacity) {
+      capacity *= 2;
+      input.data = reallocOrFail (input.data, capacity + 1);
+    }
+  }
+
+  if (ferror (instream))
+    fail ("Failed to read characters from the input stream.");
+
+  input.data[input.length] = '\0';
+  return input;
+}
+
+static void freeInput (Input *input)
+{
+  if (input->mapped)
+    munmap (input->data, input->length);
+  else
+    free (input->data);
+}
+
+typedef struct Output {
+  FILE *stream;
+  char *data;
+  size_t length;
+  /* Binary output is written as hex text. */
+  bool hex;
+} Output;
+
+static Output createOutput (FILE *stream, bool hex)
+{
+  Output output = { stream, reallocOrFail (NULL, outputBufferSize), 0, hex };
+  return output;
+}
+
+static void flushOutput (Output *output)
+{
+  if (fwrite (output->data, 1, output->length, output->stream)
+      != output->length)
+    fail ("Failed to write to the output stream.");
+
+  output->length = 0;
+}
+
+static void freeOutput (Output *output)
+{
+  flushOutput (output);
+  free (output->data);
+}
+
+/* Returns where the next needed characters can be written, the caller
+   adds the number it actually wrote to output->length. */
+static char *reserveOutput (Output *output, size_t needed)
+{
+  if (output->length + needed > outputBufferSize)
+    flushOutput (output);
+
+  return output->data + output->length;
+}
+
+static void writeString (Output *output, const char *string)
+{
+  size_t length = strlen (string);
+  memcpy (reserveOutput (output, length), string, length);
+  output->length += length;
+}
+
+static void writeBytes (Output *output, const unsigned char *bytes,
+                        size_t count)
+{
+  static const char hexDigits[] = "0123456789ABCDEF";
+  if (!output->hex) {
+    memcpy (reserveOutput (output, count), bytes, count);
+    output->length += count;
+    return;
+  }
+
+  char *result = reserveOutput (output, 2 * count);
+  for (size_t i = 0; i < count; ++i) {
+    result[2 * i] = hexDigits[bytes[i] >> 4];
+    result[2 * i + 1] = hexDigits[bytes[i] & 0xf];
+  }
+
+  output->length += 2 * count;
+}
+
+/* Encodes the lines found by the readers, one polyline per line. */
+typedef struct LineEncoder {
+  PolylineEncoder *encoder;
+  Output *output;
+  /* Geometries that aren't lines, so can't be encoded. */
+  size_t skippedCount;
+} LineEncoder;
+
+/* Coordinates out of range are an error rather than being skipped, they
+   usually mean the input isn't in latitudes and longitudes at all. */
+static void addPoint (LineEncoder *lines, double latitude, double longitude)
+{
+  Coordinate coord = { latitude, longitude };
+  char *result = reserveOutput (lines->output, POLYLINE_MAX_COORDINATE_CHARS);
+  unsigned charCount = PolylineEncoderGetEncodedCoordinate (lines->encoder,
+                                                            coord, result);
+  if (!charCount) {
+    fprintf (stderr, "The coordinate %g, %g is out of range, latitudes must "
+             "be from -90 to 90 and longitudes from -180 to 180.\n",
+             latitude, longitude);
+    exit (1);
+  }
+
+  lines->output->length += charCount;
+}
+
+static void endLine (LineEncoder *lines)
+{
+  *reserveOutput (lines->output, 1) = '\n';
+  lines->output->length += 1;
+  PolylineEncoderReset (lines->encoder, 0);
+}
+
+typedef struct JSONParser {
+  const char *start;
+  const char *position;
+  const char *end;
+  LineEncoder *lines;
+} JSONParser;
+
+typedef enum GeometryType {
+  GeometryTypeOther,
+  GeometryTypeLineString,
+  GeometryTypeMultiLineString
+} GeometryType;
+
+static void skipSpace (JSONParser *parser)
+{
+  while (parser->position < parser->end
+         && isspace ((unsigned char)*parser->position))
+    ++parser->position;
+}
+
+static bool consume (JSONParser *parser, char c)
+{
+  skipSpace (parser);
+  if (parser->position < parser->end && *parser->position == c) {
+    ++parser->position;
+    return true;
+  }
+
+  return false;
+}
+
+static void expect (JSONParser *parser, char c)
+{
+  if (!consume (parser, c)) {
+    fprintf (stderr, "Expected '%c' at byte %zu of the GeoJSON.\n", c,
+             (size_t)(parser->position - parser->start));
+    exit (1);
+  }
+}
+
+/* strtod also reads nan, inf and hex floats, which JSON doesn't have, so
+   only the characters of a JSON number are allowed. A number too large
+   for a double is rejected as well. */
+static double parseNumber (JSONParser *parser)
+{
+  skipSpace (parser);
+  char *next;
+  double value = strtod (parser->position, &next);
+  if (next == parser->position || next > parser->end)
+    fail ("Expected a number in the GeoJSON coordinates.");
+
+  for (const char *c = parser->position; c < next; ++c) {
+    if (!isdigit ((unsigned char)*c) && !strchr ("+-.eE", *c))
+      fail ("Expected a number in the GeoJSON coordinates.");
+  }
+
+  if (!isfinite (value))
+    fail ("A number in the GeoJSON coordinates is too large.");
+
+  parser->position = next;
+  return value;
+}
+
+/* Moves past a string, *start and *length are set to its contents, which
+   are left escaped. */
+static void parseString (JSONParser *parser, const char **start,
+                         size_t *length)
+{
+  expect (parser, '"');
+  *start = parser->position;
+  while (parser->position < parser->end && *parser->position != '"') {
+    if (*parser->position == '\\')
+      ++parser->position;
+
+    ++parser->position;
+  }
+
+  if (parser->position >= parser->end)
+    fail ("The GeoJSON ends part way through a string.");
+
+  *length = parser->position - *start;
+  ++parser->position;
+}
+
+static bool stringIs (const char *start, size_t length, const char *string)
+{
+  return length == strlen (string) && !memcmp (start, string, length);
+}
+
+static void parseValue (JSONParser *parser, unsigned depth);
+
+/* Reads [[lng, lat], ...], any values after the latitude are ignored. */
+static void readLineString (JSONParser *parser)
+{
+  expect (parser, '[');
+  if (!consume (parser, ']')) {
+    do {
+      expect (parser, '[');
+      double longitude = parseNumber (parser);
+      expect (parser, ',');
+      double latitude = parseNumber (parser);
+      while (consume (parser, ','))
+        parseNumber (parser);
+
+      expect (parser, ']');
+      addPoint (parser->lines, latitude, longitude);
+    } while (consume (parser, ','));
+
+    expect (parser, ']');
+  }
+
+  endLine (parser->lines);
+}
+
+static void readCoordinates (JSONParser *parser, GeometryType type,
+                             unsigned depth)
+{
+  switch (type) {
+  case GeometryTypeLineString:
+    readLineString (parser);
+    break;
+  case GeometryTypeMultiLineString:
+    expect (parser, '[');
+    if (!consume (parser, ']')) {
+      do {
+        readLineString (parser);
+      } while (consume (parser, ','));
+
+      expect (parser, ']');
+    }
+    break;
+  case GeometryTypeOther:
+    parseValue (parser, depth);
+    ++parser->lines->skippedCount;
+    break;
+  }
+}
+
+/* Looks through an object for a "type" and "coordinates". Anything else
+   is searched for more objects, so geometries are found inside Features,
+   FeatureCollections and GeometryCollections. */
+static void parseObject (JSONParser *parser, unsigned depth)
+{
+  GeometryType type = GeometryTypeOther;
+  bool hadType = false;
+  /* Coordinates that came before the type, they're read once the type is
+     known. */
+  const char *coordinates = NULL;
+
+  expect (parser, '{');
+  if (consume (parser, '}'))
+    return;
+
+  do {
+    const char *key;
+    size_t keyLength;
+    skipSpace (parser);
+    parseString (parser, &key, &keyLength);
+    expect (parser, ':');
+
+    skipSpace (parser);
+    if (stringIs (key, keyLength, "type") && parser->position < parser->end
+        && *parser->position == '"') {
+      const char *value;
+      size_t valueLength;
+      parseString (parser, &value, &valueLength);
+      hadType = true;
+      if (stringIs (value, valueLength, "LineString"))
+        type = GeometryTypeLineString;
+      else if (stringIs (value, valueLength, "MultiLineString"))
+        type = GeometryTypeMultiLineString;
+    } else if (stringIs (key, keyLength, "coordinates")) {
+      if (hadType) {
+        readCoordinates (parser, type, depth + 1);
+      } else {
+        coordinates = parser->position;
+        parseValue (parser, depth + 1);
+      }
+    } else {
+      parseValue (parser, depth + 1);
+    }
+  } while (consume (parser, ','));
+
+  expect (parser, '}');
+
+  if (coordinates) {
+    const char *objectEnd = parser->position;
+    parser->position = coordinates;
+    readCoordinates (parser, type, depth + 1);
+    parser->position = objectEnd;
+  }
+}
+
+static void parseValue (JSONParser *parser, unsigned depth)
+{
+  if (depth > maxNestingDepth)
+    fail ("The GeoJSON is nested too deeply.");
+
+  skipSpace (parser);
+  if (parser->position >= parser->end)
+    fail ("The GeoJSON ends part way through a value.");
+
+  const char *start;
+  size_t length;
+  switch (*parser->position) {
+  case '{':
+    parseObject (parser, depth);
+    break;
+  case '[':
+    ++parser->position;
+    if (consume (parser, ']'))
+      break;
+
+    do {
+      parseValue (parser, depth + 1);
+    } while (consume (parser, ','));
+
+    expect (parser, ']');
+    break;
+  case '"':
+    parseString (parser, &start, &length);
+    break;
+  default:
+    /* A number, true, false or null. */
+    start = parser->position;
+    while (parser->position < parser->end
+           && !strchr (",]} \t\r\n", *parser->position))
+      ++parser->position;
+
+    if (parser->position == start)
+      fail ("Unexpected character in the GeoJSON.");
+  }
+}
+
+static void readGeoJSON (Input *input, LineEncoder *lines)
+{
+  JSONParser parser = { input->data, input->data, input->data + input->length,
+                        lines };
+
+  /* More than one value is allowed so newline delimited GeoJSON works. */
+  skipSpace (&parser);
+  while (parser.position < parser.end) {
+    parseValue (&parser, 0);
+    skipSpace (&parser);
+  }
+}
+
+typedef struct WKBReader {
+  const unsigned char *position;
+  const unsigned char *end;
+  LineEncoder *lines;
+} WKBReader;
+
+static bool hostIsLittleEndian (void)
+{
+  uint16_t value = 1;
+  unsigned char firstByte;
+  memcpy (&firstByte, &value, 1);
+  return firstByte == 1;
+}
+
+static uint32_t swap32 (uint32_t value)
+{
+  return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000)
+         | (value << 24);
+}
+
+static uint64_t swap64 (uint64_t value)
+{
+  return ((uint64_t)swap32 ((uint32_t)value) << 32)
+         | swap32 ((uint32_t)(value >> 32));
+}
+
+static void need (WKBReader *reader, size_t count)
+{
+  if ((size_t)(reader->end - reader->position) < count)
+    fail ("The WKB ends part way through a geometry.");
+}
+
+static uint32_t readUInt32 (WKBReader *reader, bool swap)
+{
+  uint32_t value;
+  need (reader, sizeof (value));
+  memcpy (&value, reader->position, sizeof (value));
+  reader->position += sizeof (value);
+  return swap ? swap32 (value) : value;
+}
+
+/* The caller checks there's room, see readPointCount. */
+static double readDouble (WKBReader *reader, bool swap)
+{
+  uint64_t bits;
+  double value;
+  memcpy (&bits, reader->position, sizeof (bits));
+  reader->position += sizeof (bits);
+  if (swap)
+    bits = swap64 (bits);
+
+  memcpy (&value, &bits, sizeof (value));
+  return value;
+}
+
+/* Reads a point count and checks that many points are really there. */
+static uint32_t readPointCount (WKBReader *reader, bool swap,
+                                unsigned valuesPerPoint)
+{
+  uint32_t count = readUInt32 (reader, swap);
+  if (count > (size_t)(reader->end - reader->position)
+              / (valuesPerPoint * sizeof (double)))
+    fail ("The WKB ends part way through a geometry.");
+
+  return count;
+}
+
+static void readGeometry (WKBReader *reader, unsigned depth)
+{
+  if (depth > maxNestingDepth)
+    fail ("The WKB is nested too deeply.");
+
+  need (reader, 1);
+  unsigned char byteOrder = *reader->position++;
+  if (byteOrder > 1)
+    fail ("The WKB has an unknown byte order.");
+
+  bool swap = (byteOrder == 1) != hostIsLittleEndian ();
+  uint32_t type = readUInt32 (reader, swap);
+  unsigned valuesPerPoint = 2;
+  if (type & EWKB_Z_FLAG)
+    ++valuesPerPoint;
+  if (type & EWKB_M_FLAG)
+    ++valuesPerPoint;
+  /* Coordinates in any other reference system, e.g. web mercator's
+     metres, can't be encoded as they are. */
+  if ((type & EWKB_SRID_FLAG) && readUInt32 (reader, swap) != WGS84_SRID)
+    fail ("The EWKB has an SRID other than 4326 (WGS84).");
+
+  /* ISO WKB adds 1000 to the type for Z, 2000 for M and 3000 for both. */
+  type &= 0x0fffffff;
+  switch (type / 1000) {
+  case 0:
+    break;
+  case 1:
+  case 2:
+    ++valuesPerPoint;
+    break;
+  case 3:
+    valuesPerPoint += 2;
+    break;
+  default:
+    fail ("The WKB has an unknown geometry type.");
+  }
+
+  size_t pointLength = valuesPerPoint * sizeof (double);
+  uint32_t count;
+  switch (type % 1000) {
+  case WKB_POINT:
+    need (reader, pointLength);
+    reader->position += pointLength;
+    ++reader->lines->skippedCount;
+    break;
+  case WKB_LINESTRING:
+    count = readPointCount (reader, swap, valuesPerPoint);
+    for (uint32_t i = 0; i < count; ++i) {
+      double longitude = readDouble (reader, swap);
+      double latitude = readDouble (reader, swap);
+      if (!isfinite (longitude) || !isfinite (latitude))
+        fail ("The WKB has a coordinate that isn't a finite number.");
+
+      reader->position += pointLength - 2 * sizeof (double);
+      addPoint (reader->lines, latitude, longitude);
+    }
+
+    endLine (reader->lines);
+    break;
+  case WKB_POLYGON:
+    count = readUInt32 (reader, swap);
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t pointCount = readPointCount (reader, swap, valuesPerPoint);
+      reader->position += pointCount * pointLength;
+    }
+
+    ++reader->lines->skippedCount;
+    break;
+  case WKB_MULTIPOINT:
+  case WKB_MULTILINESTRING:
+  case WKB_MULTIPOLYGON:
+  case WKB_GEOMETRYCOLLECTION:
+    count = readUInt32 (reader, swap);
+    for (uint32_t i = 0; i < count; ++i)
+      readGeometry (reader, depth + 1);
+    break;
+  default:
+    fail ("The WKB has an unknown geometry type.");
+  }
+}
+
+static void readWKB (const unsigned char *data, size_t length,
+                     LineEncoder *lines)
+{
+  WKBReader reader = { data, data + length, lines };
+  while (reader.position < reader.end)
+    readGeometry (&reader, 0);
+}
+
+static int hexValue (char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+
+  return -1;
+}
+
+/* Turns hex text into bytes in place, skipping white space and the \x
+   PostgreSQL puts before bytea values. Returns the number of bytes. */
+static size_t hexToBytes (char *data, size_t length)
+{
+  size_t count = 0;
+  size_t i = 0;
+  while (i < length) {
+    if (isspace ((unsigned char)data[i])) {
+      ++i;
+    } else if (data[i] == '\\' && i + 1 < length && data[i + 1] == 'x') {
+      i += 2;
+    } else {
+      int high = hexValue (data[i]);
+      int low = i + 1 < length ? hexValue (data[i + 1]) : -1;
+      if (high < 0 || low < 0)
+        fail ("The hex WKB has a character that isn't hex.");
+
+      data[count++] = (char)(high << 4 | low);
+      i += 2;
+    }
+  }
+
+  return count;
+}
+
+bool coordinateFormatFromName (const char *name, CoordinateFormat *format)
+{
+  static const struct {
+    const char *name;
+    CoordinateFormat format;
+  } formats[] = {
+    { "text", CoordinateFormatText },
+    { "geojson", CoordinateFormatGeoJSON },
+    { "wkb", CoordinateFormatWKB },
+    { "ewkb", CoordinateFormatEWKB },
+    { "hexwkb", CoordinateFormatHexWKB },
+    { "hexewkb", CoordinateFormatHexEWKB }
+  };
+
+  for (size_t i = 0; i < sizeof (formats) / sizeof (formats[0]); ++i) {
+    if (!strcmp (name, formats[i].name)) {
+      *format = formats[i].format;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void formatEncodeLocations (FILE *instream, FILE *outstream,
+                            CoordinateFormat format)
+{
+  Input input = readInput (instream);
+  Output output = createOutput (outstream, false);
+  LineEncoder lines = { PolylineEncoderCreate (), &output, 0 };
+  if (!lines.encoder)
+    fail ("Couldn't allocate memory.");
+
+  switch (format) {
+  case CoordinateFormatGeoJSON:
+    readGeoJSON (&input, &lines);
+    break;
+  case CoordinateFormatWKB:
+  case CoordinateFormatEWKB:
+    readWKB ((const unsigned char *)input.data, input.length, &lines);
+    break;
+  case CoordinateFormatHexWKB:
+  case CoordinateFormatHexEWKB:
+    readWKB ((const unsigned char *)input.data,
+             hexToBytes (input.data, input.length), &lines);
+    break;
+  case CoordinateFormatText:
+    fail ("The text format is encoded by encodeLocations.");
+  }
+
+  if (lines.skippedCount)
+    fprintf (stderr, "Skipped %zu geometries that aren't lines.\n",
+             lines.skippedCount);
+
+  PolylineEncoderFree (lines.encoder);
+  freeOutput (&output);
+  freeInput (&input);
+}
+
+/* Writes a value in 1e-5 degrees as a decimal without going through a
+   double, trailing zeros are left off. Returns the number of characters
+   written, at most 12. */
+static size_t formatE5 (int32_t value, char *result)
+{
+  char *position = result;
+  uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+  if (value < 0)
+    *position++ = '-';
+
+  uint32_t whole = magnitude / 100000;
+  uint32_t fraction = magnitude % 100000;
+  char digits[10];
+  unsigned digitCount = 0;
+  do {
+    digits[digitCount++] = '0' + whole % 10;
+    whole /= 10;
+  } while (whole);
+
+  while (digitCount)
+    *position++ = digits[--digitCount];
+
+  if (fraction) {
+    *position++ = '.';
+    for (uint32_t divisor = 10000; divisor; divisor /= 10)
+      *position++ = '0' + fraction / divisor % 10;
+
+    while (position[-1] == '0')
+      --position;
+  }
+
+  return position - result;
+}
+
+typedef struct PolylineLine {
+  const char *start;
+  size_t length;
+} PolylineLine;
+
+/* Splits the input at new lines, empty lines are ignored. */
+static PolylineLine *splitLines (const Input *input, size_t *lineCount)
+{
+  size_t capacity = 16;
+  PolylineLine *lines = reallocOrFail (NULL, capacity * sizeof (PolylineLine));
+  const char *position = input->data;
+  const char *end = input->data + input->length;
+  *lineCount = 0;
+
+  while (position < end) {
+    const char *lineEnd = memchr (position, '\n', end - position);
+    if (!lineEnd)
+      lineEnd = end;
+
+    size_t length = lineEnd - position;
+    if (length && position[length - 1] == '\r')
+      --length;
+
+    if (length) {
+      if (*lineCount == capacity) {
+        capacity *= 2;
+        lines = reallocOrFail (lines, capacity * sizeof (PolylineLine));
+      }
+
+      lines[(*lineCount)++] = (PolylineLine){ position, length };
+    }
+
+    position = lineEnd + 1;
+  }
+
+  return lines;
+}
+
+static void invalidLine (size_t lineNumber)
+{
+  fprintf (stderr, "Polyline %zu isn't a valid polyline.\n", lineNumber + 1);
+  exit (1);
+}
+
+static void writeGeoJSONLine (Output *output, PolylineLine line,
+                              size_t lineNumber)
+{
+  const char *position = line.start;
+  const char *end = line.start + line.length;
+  int32_t intLat = 0, intLng = 0;
+  bool first = true;
+
+  writeString (output, "[");
+  while (polylineReadCoordinate (&position, end, &intLat, &intLng)) {
+    char *start = reserveOutput (output, maxGeoJSONPointLength);
+    char *result = start;
+    if (!first)
+      *result++ = ',';
+
+    *result++ = '[';
+    result += formatE5 (intLng, result);
+    *result++ = ',';
+    result += formatE5 (intLat, result);
+    *result++ = ']';
+    output->length += result - start;
+    first = false;
+  }
+
+  if (position != end)
+    invalidLine (lineNumber);
+
+  writeString (output, "]");
+}
+
+static void putUInt32 (unsigned char *bytes, uint32_t value)
+{
+  for (unsigned i = 0; i < 4; ++i)
+    bytes[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void putDouble (unsigned char *bytes, double value)
+{
+  uint64_t bits;
+  memcpy (&bits, &value, sizeof (bits));
+  for (unsigned i = 0; i < 8; ++i)
+    bytes[i] = (unsigned char)(bits >> (8 * i));
+}
+
+/* Geometries are always written little endian. */
+static void writeWKBHeader (Output *output, uint32_t type, bool withSRID,
+                            uint32_t count)
+{
+  unsigned char header[13];
+  size_t length = 0;
+  header[length++] = 1;
+  putUInt32 (header + length, withSRID ? type | EWKB_SRID_FLAG : type);
+  length += 4;
+  if (withSRID) {
+    putUInt32 (header + length, WGS84_SRID);
+    length += 4;
+  }
+
+  putUInt32 (header + length, count);
+  length += 4;
+  writeBytes (output, header, length);
+}
+
+static void writeWKBLine (Output *output, PolylineLine line, bool withSRID,
+                          size_t lineNumber)
+{
+  /* The point count comes first, counting the values gives it without
+     decoding the line twice. */
+  size_t pointCount = polylineCountValues (line.start, line.length) / 2;
+  if (pointCount > UINT32_MAX)
+    fail ("A polyline has too many points for WKB.");
+
+  writeWKBHeader (output, WKB_LINESTRING, withSRID, (uint32_t)pointCount);
+
+  const char *position = line.start;
+  const char *end = line.start + line.length;
+  int32_t intLat = 0, intLng = 0;
+  unsigned char point[16];
+  while (polylineReadCoordinate (&position, end, &intLat, &intLng)) {
+    putDouble (point, intLng * 1e-5);
+    putDouble (point + 8, intLat * 1e-5);
+    writeBytes (output, point, sizeof (point));
+  }
+
+  if (position != end)
+    invalidLine (lineNumber);
+}
+
+void formatDecodeLocations (FILE *instream, FILE *outstream,
+                            CoordinateFormat format)
+{
+  Input input = readInput (instream);
+  size_t lineCount;
+  PolylineLine *lines = splitLines (&input, &lineCount);
+  /* No polylines is written as an empty LineString. */
+  PolylineLine emptyLine = { input.data, 0 };
+  if (!lineCount) {
+    lines[0] = emptyLine;
+    lineCount = 1;
+  }
+
+  bool multi = lineCount > 1;
+  bool hex = format == CoordinateFormatHexWKB
+             || format == CoordinateFormatHexEWKB;
+  bool withSRID = format == CoordinateFormatEWKB
+                  || format == CoordinateFormatHexEWKB;
+  Output output = createOutput (outstream, hex);
+
+  switch (format) {
+  case CoordinateFormatGeoJSON:
+    writeString (&output, multi ? "{\"type\":\"MultiLineString\",\"coordinates\":["
+                                : "{\"type\":\"LineString\",\"coordinates\":");
+    for (size_t i = 0; i < lineCount; ++i) {
+      if (i)
+        writeString (&output, ",");
+
+      writeGeoJSONLine (&output, lines[i], i);
+    }
+
+    writeString (&output, multi ? "]}\n" : "}\n");
+    break;
+  case CoordinateFormatWKB:
+  case CoordinateFormatEWKB:
+  case CoordinateFormatHexWKB:
+  case CoordinateFormatHexEWKB:
+    if (multi) {
+      /* In EWKB only the outer geometry has the SRID. */
+      writeWKBHeader (&output, WKB_MULTILINESTRING, withSRID,
+                      (uint32_t)lineCount);
+      for (size_t i = 0; i < lineCount; ++i)
+        writeWKBLine (&output, lines[i], false, i);
+    } else {
+      writeWKBLine (&output, lines[0], withSRID, 0);
+    }
+
+    if (hex)
+      writeString (&output, "\n");
+    break;
+  case CoordinateFormatText:
+    fail ("The text format is decoded by decodeLocations.");
+  }
+
+  freeOutput (&output);
+  free (lines);
+  freeInput (&input);
+}
@@ -0,0 +1,51 @@
+//
+//  PolylineFormats.h
+//  PolylineTool
+//
+//  Lets PolylineTool encode polylines straight from GeoJSON or WKB and
+//  decode them straight to GeoJSON or WKB, rather than going through the
+//  "lat, lng" text format.
+//
+
+#ifndef PolylineTool_PolylineFormats_h
+#define PolylineTool_PolylineFormats_h
+
+#include <stdio.h>
+#include <stdbool.h>
+
+typedef enum CoordinateFormat {
+  /* "lat, lng" lines, handled by encodeLocations and decodeLocations. */
+  CoordinateFormatText,
+  /* A GeoJSON LineString or MultiLineString, when reading they can also be
+     inside Features, FeatureCollections and GeometryCollections. */
+  CoordinateFormatGeoJSON,
+  /* Binary OGC WKB. When reading, WKB and EWKB are both accepted in
+     either byte order, with or without Z and M values. */
+  CoordinateFormatWKB,
+  /* Binary PostGIS EWKB, written with SRID 4326. */
+  CoordinateFormatEWKB,
+  /* WKB and EWKB as hex text, one geometry per line, the way PostGIS
+     prints geometries. */
+  CoordinateFormatHexWKB,
+  CoordinateFormatHexEWKB
+} CoordinateFormat;
+
+/* Sets *format from a name given to -F, e.g. "geojson" or "hexewkb".
+   Returns false if the name isn't a format. */
+bool coordinateFormatFromName (const char *name, CoordinateFormat *format);
+
+/* Encodes every LineString read from instream, and every line of every
+   MultiLineString, writing one polyline per line to outstream. Exits
+   with a message if the input isn't valid, which includes coordinates
+   that aren't finite numbers (nan and inf, or hex floats in GeoJSON),
+   coordinates out of range and EWKB with an SRID other than 4326. */
+void formatEncodeLocations (FILE *instream, FILE *outstream,
+                            CoordinateFormat format);
+
+/* Decodes the polylines read from instream, one per line, to a single
+   geometry. One polyline gives a LineString, more than one gives a
+   MultiLineString. */
+void formatDecodeLocations (FILE *instream, FILE *outstream,
+                            CoordinateFormat format);
+
+#endif
@@ -0,0 +1,562 @@
+//
+//  PolylinePipeline.c
+//  PolylineTool
+//
+
+/* Needed for pthreads, sched_yield and nanosleep when compiling with
+   -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "PolylinePipeline.h"
+#include "polylineFunctions.h"
+#include "polylineVarint.h"
+
+/* The number of bytes read from the input at a time. */
+static const size_t chunkSize = 1 << 20;
+
+/* The most characters a formatted "lat, lng\n" line can take. */
+static const size_t maxDecodedLineLength = 64;
+
+/* A slot holds one chunk on its way through the pipeline. Its ticket is
+   sequence * 8 + state, where sequence is the number of the chunk (in
+   the order it was read) the slot is holding or waiting for. Each stage
+   waits for the ticket it expects, so the slots form a bounded lock free
+   queue between the reader, the workers and the writer:
+     Empty:  The reader can fill the slot with chunk sequence.
+     Filled: The chunk has been read, a worker can encode/decode it.
+     Summed: Decoding only, the worker has added up the chunk's
+             differences. The writer keeps a running total of these to
+             give each chunk the latitude and longitude it starts from.
+     Based:  Decoding only, the chunk's starting values are set and the
+             worker can decode it.
+     Done:   The chunk's output is ready for the writer. When the writer
+             has written it the slot is moved to Empty for chunk
+             sequence + slotCount. */
+typedef enum SlotState {
+  SlotStateEmpty,
+  SlotStateFilled,
+  SlotStateSummed,
+  SlotStateBased,
+  SlotStateDone
+} SlotState;
+
+typedef struct PipelineSlot {
+  size_t ticket;
+
+  char *input;
+  size_t inputLength;
+  size_t inputCapacity;
+
+  char *output;
+  size_t outputLength;
+  size_t outputCapacity;
+
+  /* Set by the worker, the output up to the problem is still written
+     and then the pipeline stops. */
+  PolylineStatus status;
+
+  /* When encoding, a chunk is encoded as if it were the start of the
+     polyline. The writer re-encodes the first coordinate as the
+     difference from the last coordinate of the previous chunk. */
+  unsigned coordCount;
+  Coordinate first;
+  Coordinate last;
+  unsigned firstLength;
+
+  /* When decoding, the total of the chunk's differences, and the
+     latitude and longitude at the start of the chunk from the writer.
+     decodeLength is the length of the complete coordinates before any
+     character that can't be part of a polyline, stop is set if there was
+     one and the chunk is the last one written. */
+  int32_t sumLat;
+  int32_t sumLng;
+  int32_t baseLat;
+  int32_t baseLng;
+  size_t decodeLength;
+  bool stop;
+} PipelineSlot;
+
+typedef struct Pipeline {
+  PipelineSlot *slots;
+  unsigned slotCount;
+  bool decode;
+  FILE *outstream;
+  /* The next chunk for a worker to take. */
+  size_t nextToProcess;
+  /* The number of chunks, SIZE_MAX until the reader reaches the end. */
+  size_t chunkCount;
+  /* Set by the writer once it won't write any more, the reader stops. */
+  bool stopped;
+
+  /* Only used by the writer. The next chunk to give its starting values
+     and the values it starts from. */
+  size_t nextToBase;
+  int32_t intLat;
+  int32_t intLng;
+  PolylineStatus status;
+} Pipeline;
+
+static inline size_t ticket (size_t sequence, SlotState state)
+{
+  return sequence * 8 + state;
+}
+
+static inline size_t loadTicket (PipelineSlot *slot)
+{
+  return __atomic_load_n (&slot->ticket, __ATOMIC_ACQUIRE);
+}
+
+static inline void storeTicket (PipelineSlot *slot, size_t value)
+{
+  __atomic_store_n (&slot->ticket, value, __ATOMIC_RELEASE);
+}
+
+static inline size_t loadChunkCount (Pipeline *pipeline)
+{
+  return __atomic_load_n (&pipeline->chunkCount, __ATOMIC_ACQUIRE);
+}
+
+/* Waiting stages spin briefly, then yield, then sleep so that a stage
+   that is waiting on the disk doesn't hold on to a core. */
+static void backOff (unsigned *spins)
+{
+  ++*spins;
+  if (*spins < 64)
+    return;
+
+  if (*spins < 1024) {
+    sched_yield ();
+    return;
+  }
+
+  struct timespec wait = { 0, 50000 };
+  nanosleep (&wait, NULL);
+}
+
+/* Grows *buffer to hold needed bytes. Returns false, leaving the buffer
+   as it was, if it couldn't. */
+static bool reserve (char **buffer, size_t *capacity, size_t needed)
+{
+  if (needed <= *capacity)
+    return true;
+
+  size_t newCapacity = needed + needed / 2;
+  char *newBuffer = realloc (*buffer, newCapacity);
+  if (!newBuffer)
+    return false;
+
+  *buffer = newBuffer;
+  *capacity = newCapacity;
+  return true;
+}
+
+/* Parses "lat, lng" lines the same way nextLocation does. */
+static void encodeChunk (PipelineSlot *slot)
+{
+  PolylineEncoder *encoder = PolylineEncoderCreate ();
+  char *position = slot->input;
+  char *next;
+
+  slot->outputLength = 0;
+  slot->coordCount = 0;
+  slot->status = PolylineStatusSuccess;
+  if (!encoder) {
+    slot->status = PolylineStatusOutOfMemory;
+    return;
+  }
+
+  while (true) {
+    while (isspace ((unsigned char)*position))
+      ++position;
+
+    if (*position == '\0')
+      break;
+
+    Coordinate coord;
+    coord.latitude = strtod (position, &next);
+    if (next == position || *next != ',') {
+      slot->status = PolylineStatusMalformedInput;
+      break;
+    }
+
+    position = next + 1;
+    coord.longitude = strtod (position, &next);
+    if (next == position) {
+      slot->status = PolylineStatusMalformedInput;
+      break;
+    }
+
+    position = next;
+    if (!reserve (&slot->output, &slot->outputCapacity, slot->outputLength
+                  + POLYLINE_MAX_COORDINATE_CHARS)) {
+      slot->status = PolylineStatusOutOfMemory;
+      break;
+    }
+
+    unsigned charCount = PolylineEncoderGetEncodedCoordinate (encoder, coord,
+                                                              slot->output
+                                                              + slot->outputLength);
+    if (!charCount) {
+      slot->status = PolylineStatusInvalidArgument;
+      break;
+    }
+
+    if (!slot->coordCount) {
+      slot->first = coord;
+      slot->firstLength = charCount;
+    }
+
+    slot->last = coord;
+    ++slot->coordCount;
+    slot->outputLength += charCount;
+  }
+
+  PolylineEncoderFree (encoder);
+}
+
+/* The first pass over a chunk when decoding, adds up its differences
+   so the writer can work out where the following chunks start. */
+static void sumChunk (PipelineSlot *slot)
+{
+  size_t length = 0;
+  while (length < slot->inputLength && slot->input[length] >= 63
+         && slot->input[length] <= 126)
+    ++length;
+
+  const char *position = slot->input;
+  int32_t intLat = 0, intLng = 0;
+  while (polylineReadCoordinate (&position, slot->input + length,
+                                 &intLat, &intLng))
+    ;
+
+  slot->sumLat = intLat;
+  slot->sumLng = intLng;
+  slot->decodeLength = position - slot->input;
+  slot->stop = length < slot->inputLength;
+}
+
+static void decodeChunk (PipelineSlot *slot)
+{
+  const char *position = slot->input;
+  const char *end = slot->input + slot->decodeLength;
+  int32_t intLat = slot->baseLat;
+  int32_t intLng = slot->baseLng;
+
+  slot->outputLength = 0;
+  slot->status = PolylineStatusSuccess;
+  while (polylineReadCoordinate (&position, end, &intLat, &intLng)) {
+    if (!reserve (&slot->output, &slot->outputCapacity,
+                  slot->outputLength + maxDecodedLineLength)) {
+      slot->status = PolylineStatusOutOfMemory;
+      return;
+    }
+
+    slot->outputLength += snprintf (slot->output + slot->outputLength,
+                                    maxDecodedLineLength, "%lf, %lf\n",
+                                    intLat * 1e-5, intLng * 1e-5);
+  }
+}
+
+static void *pipelineWorker (void *info)
+{
+  Pipeline *pipeline = info;
+  while (true) {
+    size_t sequence = __atomic_fetch_add (&pipeline->nextToProcess, 1,
+                                          __ATOMIC_RELAXED);
+    PipelineSlot *slot = &pipeline->slots[sequence % pipeline->slotCount];
+    unsigned spins = 0;
+    while (loadTicket (slot) != ticket (sequence, SlotStateFilled)) {
+      if (sequence >= loadChunkCount (pipeline))
+        return NULL;
+
+      backOff (&spins);
+    }
+
+    if (pipeline->decode) {
+      sumChunk (slot);
+      storeTicket (slot, ticket (sequence, SlotStateSummed));
+      /* The writer gives the chunk its starting values once every chunk
+         before it has been summed. */
+      spins = 0;
+      while (loadTicket (slot) != ticket (sequence, SlotStateBased))
+        backOff (&spins);
+
+      decodeChunk (slot);
+    } else {
+      encodeChunk (slot);
+    }
+
+    storeTicket (slot, ticket (sequence, SlotStateDone));
+  }
+}
+
+static void writeEncodedChunk (PipelineSlot *slot, PolylineEncoder *encoder,
+                               bool isFirstChunk, FILE *outstream)
+{
+  if (!slot->coordCount)
+    return;
+
+  char buffer[POLYLINE_MAX_COORDINATE_CHARS];
+  if (isFirstChunk) {
+    fwrite (slot->output, sizeof (char), slot->outputLength, outstream);
+  } else {
+    /* encoder's running values are the last coordinate of the previous
+       chunk, so this gives the first coordinate as a difference. */
+    unsigned charCount = PolylineEncoderGetEncodedCoordinate (encoder,
+                                                              slot->first,
+                                                              buffer);
+    fwrite (buffer, sizeof (char), charCount, outstream);
+    fwrite (slot->output + slot->firstLength, sizeof (char),
+            slot->outputLength - slot->firstLength, outstream);
+  }
+
+  PolylineEncoderGetEncodedCoordinate (encoder, slot->last, buffer);
+}
+
+/* Gives the summed chunks, in order, the latitude and longitude they
+   start from. Returns true if any were given them. */
+static bool baseChunks (Pipeline *pipeline)
+{
+  bool based = false;
+  while (true) {
+    size_t sequence = pipeline->nextToBase;
+    PipelineSlot *slot = &pipeline->slots[sequence % pipeline->slotCount];
+    if (loadTicket (slot) != ticket (sequence, SlotStateSummed))
+      return based;
+
+    slot->baseLat = pipeline->intLat;
+    slot->baseLng = pipeline->intLng;
+    /* Added as unsigned, the same as polylineReadValue. */
+    pipeline->intLat = (int32_t)((uint32_t)pipeline->intLat
+                                 + (uint32_t)slot->sumLat);
+    pipeline->intLng = (int32_t)((uint32_t)pipeline->intLng
+                                 + (uint32_t)slot->sumLng);
+    storeTicket (slot, ticket (sequence, SlotStateBased));
+    ++pipeline->nextToBase;
+    based = true;
+  }
+}
+
+/* Once the output has stopped the remaining chunks are still taken from
+   the workers, so that they and the reader can finish, but not written. */
+static void stopWriting (Pipeline *pipeline, PolylineStatus status)
+{
+  pipeline->status = status;
+  __atomic_store_n (&pipeline->stopped, true, __ATOMIC_RELEASE);
+}
+
+static void *pipelineWriter (void *info)
+{
+  Pipeline *pipeline = info;
+  PolylineEncoder *encoder = NULL;
+  bool wroteCoordinates = false;
+
+  if (!pipeline->decode && !(encoder = PolylineEncoderCreate ()))
+    stopWriting (pipeline, PolylineStatusOutOfMemory);
+
+  for (size_t sequence = 0; ; ++sequence) {
+    PipelineSlot *slot = &pipeline->slots[sequence % pipeline->slotCount];
+    unsigned spins = 0;
+    while (loadTicket (slot) != ticket (sequence, SlotStateDone)) {
+      if (pipeline->decode && baseChunks (pipeline)) {
+        spins = 0;
+        continue;
+      }
+
+      if (sequence >= loadChunkCount (pipeline)) {
+        if (pipeline->status == PolylineStatusSuccess)
+          fprintf (pipeline->outstream, "\n");
+
+        if (encoder)
+          PolylineEncoderFree (encoder);
+
+        return NULL;
+      }
+
+      backOff (&spins);
+    }
+
+    if (!pipeline->stopped) {
+      if (pipeline->decode) {
+        fwrite (slot->output, sizeof (char), slot->outputLength,
+                pipeline->outstream);
+        if (slot->stop)
+          stopWriting (pipeline, PolylineStatusSuccess);
+      } else {
+        writeEncodedChunk (slot, encoder, !wroteCoordinates,
+                           pipeline->outstream);
+        wroteCoordinates |= slot->coordCount > 0;
+      }
+
+      if (slot->status != PolylineStatusSuccess)
+        stopWriting (pipeline, slot->status);
+    }
+
+    storeTicket (slot, ticket (sequence + pipeline->slotCount,
+                               SlotStateEmpty));
+  }
+}
+
+/* Returns the length of the chunk up to and including the last new line. */
+static size_t encodeChunkLength (const char *input, size_t length)
+{
+  while (length && input[length - 1] != '\n')
+    --length;
+
+  return length;
+}
+
+static inline bool continuesValue (char c)
+{
+  /* The same test polylineCountValues uses. */
+  return (c - 63) & 0x20;
+}
+
+/* Returns the length of the chunk up to the end of the last complete
+   coordinate. The chunk is split using the characters that end each
+   value, so the reader doesn't have to decode anything. Characters that
+   can't be part of a polyline are left for the workers to find. */
+static size_t decodeChunkLength (const char *input, size_t length)
+{
+  while (length && continuesValue (input[length - 1]))
+    --length;
+
+  /* Each coordinate is two values, if there's an odd number the last one
+     is a latitude. */
+  if (polylineCountValues (input, length) % 2) {
+    --length;
+    while (length && continuesValue (input[length - 1]))
+      --length;
+  }
+
+  return length;
+}
+
+static PolylineStatus runPipeline (FILE *instream, FILE *outstream,
+                                   unsigned workerCount, bool decode)
+{
+  Pipeline pipeline = { 0 };
+  pipeline.slotCount = 2 * workerCount + 2;
+  pipeline.slots = calloc (pipeline.slotCount, sizeof (PipelineSlot));
+  pipeline.decode = decode;
+  pipeline.outstream = outstream;
+  pipeline.chunkCount = SIZE_MAX;
+
+  pthread_t writer;
+  pthread_t *workers = malloc (workerCount * sizeof (pthread_t));
+  if (!pipeline.slots || !workers) {
+    free (pipeline.slots);
+    free (workers);
+    return PolylineStatusOutOfMemory;
+  }
+
+  for (unsigned i = 0; i < pipeline.slotCount; ++i)
+    pipeline.slots[i].ticket = ticket (i, SlotStateEmpty);
+
+  if (pthread_create (&writer, NULL, pipelineWriter, &pipeline)) {
+    free (pipeline.slots);
+    free (workers);
+    return PolylineStatusOutOfMemory;
+  }
+
+  /* Carry on with fewer workers if they can't all be started. */
+  unsigned startedCount = 0;
+  while (startedCount < workerCount
+         && !pthread_create (&workers[startedCount], NULL, pipelineWorker,
+                             &pipeline))
+    ++startedCount;
+
+  /* The part of the previous read that wasn't a complete line or
+     coordinate, it's put at the start of the next chunk. */
+  char *carry = NULL;
+  size_t carryLength = 0;
+  size_t carryCapacity = 0;
+  PolylineStatus status = startedCount ? PolylineStatusSuccess
+                                       : PolylineStatusOutOfMemory;
+  bool finished = !startedCount;
+  size_t sequence = 0;
+
+  for (; !finished; ++sequence) {
+    PipelineSlot *slot = &pipeline.slots[sequence % pipeline.slotCount];
+    unsigned spins = 0;
+    while (loadTicket (slot) != ticket (sequence, SlotStateEmpty))
+      backOff (&spins);
+
+    if (__atomic_load_n (&pipeline.stopped, __ATOMIC_ACQUIRE))
+      break;
+
+    if (!reserve (&slot->input, &slot->inputCapacity,
+                  carryLength + chunkSize + 1)) {
+      status = PolylineStatusOutOfMemory;
+      break;
+    }
+
+    if (carryLength)
+      memcpy (slot->input, carry, carryLength);
+
+    size_t readCount = fread (slot->input + carryLength, sizeof (char),
+                              chunkSize, instream);
+    size_t length = carryLength + readCount;
+    /* A read error ends the input here, the caller can check ferror. */
+    finished = readCount < chunkSize;
+
+    size_t chunkLength;
+    if (decode)
+      chunkLength = decodeChunkLength (slot->input, length);
+    else
+      chunkLength = finished ? length : encodeChunkLength (slot->input, length);
+
+    carryLength = length - chunkLength;
+    if (!reserve (&carry, &carryCapacity, carryLength)) {
+      status = PolylineStatusOutOfMemory;
+      carryLength = 0;
+      finished = true;
+    }
+
+    if (carryLength)
+      memcpy (carry, slot->input + chunkLength, carryLength);
+
+    slot->input[chunkLength] = '\0';
+    slot->inputLength = chunkLength;
+    storeTicket (slot, ticket (sequence, SlotStateFilled));
+  }
+
+  __atomic_store_n (&pipeline.chunkCount, sequence, __ATOMIC_RELEASE);
+
+  for (unsigned i = 0; i < startedCount; ++i)
+    pthread_join (workers[i], NULL);
+
+  pthread_join (writer, NULL);
+
+  for (unsigned i = 0; i < pipeline.slotCount; ++i) {
+    free (pipeline.slots[i].input);
+    free (pipeline.slots[i].output);
+  }
+
+  free (carry);
+  free (workers);
+  free (pipeline.slots);
+  return pipeline.status != PolylineStatusSuccess ? pipeline.status : status;
+}
+
+PolylineStatus pipelineEncodeLocations (FILE *instream, FILE *outstream,
+                                        unsigned workerCount)
+{
+  return runPipeline (instream, outstream, workerCount, false);
+}
+
+PolylineStatus pipelineDecodeLocations (FILE *instream, FILE *outstream,
+                                        unsigned workerCount)
+{
+  return runPipeline (instream, outstream, workerCount, true);
+}
@@ -0,0 +1,40 @@
+//
+//  PolylinePipeline.h
+//  PolylineTool
+//
+//  Multithreaded versions of PolylineTool's encodeLocations and
+//  decodeLocations. The main thread reads the input in large chunks, the
+//  chunks are encoded or decoded by a set of worker threads and a writer
+//  thread writes the results out in the order they were read, so reading,
+//  the codec work and writing all overlap.
+//
+
+#ifndef PolylineTool_PolylinePipeline_h
+#define PolylineTool_PolylinePipeline_h
+
+#include <stdio.h>
+
+#include "polylineFunctions.h"
+
+/* Encodes the "lat, lng" lines read from instream to a polyline, the
+   output is the same as encodeLocations.
+   workerCount: The number of threads encoding chunks.
+   return: PolylineStatusMalformedInput if a line isn't "lat, lng" and
+           PolylineStatusInvalidArgument if the coordinate is out of range,
+           the coordinates before it are written, or PolylineStatusOutOfMemory
+           if the buffers or threads couldn't be allocated. The threads
+           have all finished when it returns. A read error ends the input
+           early, check ferror (instream) to tell. */
+PolylineStatus pipelineEncodeLocations (FILE *instream, FILE *outstream,
+                                        unsigned workerCount);
+
+/* Decodes the polyline read from instream to "lat, lng" lines. Decoding
+   stops at the first character outside '?' to '~', such as a new line,
+   so only the first of several lines is decoded. decodeLocations stops
+   at the same character.
+   return: The same as pipelineEncodeLocations, other than a stop not
+           being malformed input. */
+PolylineStatus pipelineDecodeLocations (FILE *instream, FILE *outstream,
+                                        unsigned workerCount);
+
+#endif
@@ -0,0 +1,375 @@
+/* PolylineReplay pushes a corpus made by PolylineCorpusGen through the
+   polyline code at a target rate and reports the throughput and the
+   latency percentiles. Latencies are measured from when each polyline
+   was due to start, so time spent falling behind the target rate counts
+   against the latency rather than being hidden. */
+
+/* Needed for getopt, clock_gettime and nanosleep when compiling with
+   -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "polylineFunctions.h"
+
+typedef enum ReplayMode {
+  ReplayModeDecode,
+  ReplayModeEncode,
+  ReplayModeRoundTrip,
+  ReplayModeTool
+} ReplayMode;
+
+typedef struct Corpus {
+  size_t count;
+  char **encoded;
+  Coordinate **coords;
+  size_t *coordCounts;
+  size_t totalCoords;
+  size_t totalBytes;
+} Corpus;
+
+/* The file runTool writes each polyline to, it's removed when the replay
+   exits. */
+static char toolInputFile[] = "/tmp/PolylineReplayXXXXXX";
+
+static void removeToolInputFile (void)
+{
+  unlink (toolInputFile);
+}
+
+/* realloc that exits if the memory isn't there, the corpus and latencies
+   all have to fit for the replay to run. */
+static void *reallocOrExit (void *memory, size_t size)
+{
+  memory = realloc (memory, size);
+  if (!memory) {
+    fprintf (stderr, "Couldn't allocate %zu bytes.\n", size);
+    exit (1);
+  }
+
+  return memory;
+}
+
+static uint64_t now ()
+{
+  struct timespec time;
+  clock_gettime (CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000u + time.tv_nsec;
+}
+
+static void sleepUntil (uint64_t time)
+{
+  uint64_t current = now ();
+  if (current >= time)
+    return;
+
+  uint64_t wait = time - current;
+  struct timespec duration = { (time_t)(wait / 1000000000u),
+                               (long)(wait % 1000000000u) };
+  nanosleep (&duration, NULL);
+}
+
+static char *readFile (const char *fileName, size_t *length)
+{
+  FILE *file = fopen (fileName, "rb");
+  if (!file) {
+    fprintf (stderr, "Couldn't open corpus %s\n", fileName);
+    exit (1);
+  }
+
+  size_t capacity = 1 << 20;
+  char *data = reallocOrExit (NULL, capacity);
+  *length = 0;
+  size_t readCount;
+  while ((readCount = fread (data + *length, 1, capacity - *length, file))) {
+    *length += readCount;
+    if (*length == capacity) {
+      capacity *= 2;
+      data = reallocOrExit (data, capacity);
+    }
+  }
+
+  fclose (file);
+  return data;
+}
+
+static void addToCorpus (Corpus *corpus, size_t *capacity, char *encoded,
+                         Coordinate *coords, size_t coordCount)
+{
+  if (corpus->count == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 1024;
+    corpus->encoded = reallocOrExit (corpus->encoded,
+                                     *capacity * sizeof (char *));
+    corpus->coords = reallocOrExit (corpus->coords,
+                                    *capacity * sizeof (Coordinate *));
+    corpus->coordCounts = reallocOrExit (corpus->coordCounts,
+                                         *capacity * sizeof (size_t));
+  }
+
+  if (!encoded) {
+    fprintf (stderr, "Couldn't allocate polyline %zu.\n", corpus->count);
+    exit (1);
+  }
+
+  corpus->encoded[corpus->count] = encoded;
+  corpus->coords[corpus->count] = coords;
+  corpus->coordCounts[corpus->count] = coordCount;
+  corpus->totalCoords += coordCount;
+  corpus->totalBytes += strlen (encoded);
+  ++corpus->count;
+}
+
+/* Loads the corpus, working out both the encoded and decoded form of
+   every polyline before anything is timed. */
+static Corpus loadCorpus (const char *fileName, bool binary)
+{
+  Corpus corpus;
+  memset (&corpus, 0, sizeof (corpus));
+  size_t capacity = 0;
+  size_t length;
+  char *data = readFile (fileName, &length);
+
+  if (binary) {
+    size_t position = 0;
+    while (position + sizeof (uint32_t) <= length) {
+      uint32_t count;
+      memcpy (&count, data + position, sizeof (count));
+      position += sizeof (count);
+      if (position + count * sizeof (Coordinate) > length) {
+        fprintf (stderr, "The corpus ends part way through a trace.\n");
+        exit (1);
+      }
+
+      Coordinate *coords = reallocOrExit (NULL, count * sizeof (Coordinate) + 1);
+      memcpy (coords, data + position, count * sizeof (Coordinate));
+      position += count * sizeof (Coordinate);
+      addToCorpus (&corpus, &capacity,
+                   copyEncodedLocationsString (coords, count), coords, count);
+    }
+  } else {
+    char *line = data;
+    char *end = data + length;
+    while (line < end) {
+      char *lineEnd = memchr (line, '\n', end - line);
+      if (!lineEnd)
+        lineEnd = end;
+
+      if (lineEnd > line) {
+        char *encoded = reallocOrExit (NULL, lineEnd - line + 1);
+        memcpy (encoded, line, lineEnd - line);
+        encoded[lineEnd - line] = '\0';
+        size_t count;
+        Coordinate *coords = decodeLocationsString (encoded, &count);
+        addToCorpus (&corpus, &capacity, encoded, coords, count);
+      }
+
+      line = lineEnd + 1;
+    }
+  }
+
+  free (data);
+  return corpus;
+}
+
+/* Runs PolylineTool on the polyline, the time includes starting the
+   process. */
+static void runTool (const char *toolPath, const char *encoded)
+{
+  static bool madeInputFile = false;
+  if (!madeInputFile) {
+    int fd = mkstemp (toolInputFile);
+    if (fd == -1) {
+      fprintf (stderr, "Couldn't make a temporary file.\n");
+      exit (1);
+    }
+
+    close (fd);
+    atexit (removeToolInputFile);
+    madeInputFile = true;
+  }
+
+  FILE *input = fopen (toolInputFile, "w");
+  if (!input) {
+    fprintf (stderr, "Couldn't write to %s.\n", toolInputFile);
+    exit (1);
+  }
+
+  fputs (encoded, input);
+  fclose (input);
+
+  char command[1024];
+  snprintf (command, sizeof (command), "%s -d -i %s > /dev/null",
+            toolPath, toolInputFile);
+  if (system (command)) {
+    fprintf (stderr, "%s failed.\n", command);
+    exit (1);
+  }
+}
+
+static void runOne (const Corpus *corpus, size_t index, ReplayMode mode,
+                    const char *toolPath)
+{
+  size_t count;
+  Coordinate *decoded;
+  char *encoded;
+
+  switch (mode) {
+  case ReplayModeDecode:
+    decoded = decodeLocationsString (corpus->encoded[index], &count);
+    free (decoded);
+    break;
+  case ReplayModeEncode:
+    encoded = copyEncodedLocationsString (corpus->coords[index],
+                                          corpus->coordCounts[index]);
+    free (encoded);
+    break;
+  case ReplayModeRoundTrip:
+    decoded = decodeLocationsString (corpus->encoded[index], &count);
+    encoded = copyEncodedLocationsString (decoded, count);
+    if (!encoded || strcmp (encoded, corpus->encoded[index])) {
+      fprintf (stderr, "Polyline %zu didn't survive a round trip.\n", index);
+      exit (1);
+    }
+
+    free (decoded);
+    free (encoded);
+    break;
+  case ReplayModeTool:
+    runTool (toolPath, corpus->encoded[index]);
+    break;
+  }
+}
+
+static int compareLatencies (const void *a, const void *b)
+{
+  uint64_t first = *(const uint64_t *)a;
+  uint64_t second = *(const uint64_t *)b;
+  return (first > second) - (first < second);
+}
+
+static double percentile (const uint64_t *sorted, size_t count, double fraction)
+{
+  size_t index = (size_t)(fraction * count);
+  if (index >= count)
+    index = count - 1;
+
+  return sorted[index] / 1000.0;
+}
+
+static void usage ()
+{
+  printf ("PolylineReplay: replays a polyline corpus and reports latencies.\n\n"
+          "PolylineReplay -i <Corpus> [-bmrlt]\n"
+          "-i <FileName> The corpus made by PolylineCorpusGen.\n"
+          "-b The corpus is in the binary format.\n"
+          "-m <decode|encode|roundtrip|tool> What to time, default decode. "
+          "tool runs PolylineTool -d for each polyline.\n"
+          "-r <Rate> The number of polylines to start per second, default 0 "
+          "which runs them back to back.\n"
+          "-l <Loops> The number of times to replay the corpus, default 1.\n"
+          "-t <Path> The PolylineTool to run, default ./PolylineTool.\n");
+
+  exit (1);
+}
+
+int main (int argc, char **argv)
+{
+  const char *corpusFile = NULL;
+  const char *toolPath = "./PolylineTool";
+  bool binary = false;
+  ReplayMode mode = ReplayModeDecode;
+  double rate = 0;
+  unsigned loops = 1;
+  int ch;
+
+  while ((ch = getopt (argc, argv, "i:bm:r:l:t:")) != -1) {
+    switch (ch) {
+    case 'i':
+      corpusFile = optarg;
+      break;
+    case 'b':
+      binary = true;
+      break;
+    case 'm':
+      if (!strcmp (optarg, "decode"))
+        mode = ReplayModeDecode;
+      else if (!strcmp (optarg, "encode"))
+        mode = ReplayModeEncode;
+      else if (!strcmp (optarg, "roundtrip"))
+        mode = ReplayModeRoundTrip;
+      else if (!strcmp (optarg, "tool"))
+        mode = ReplayModeTool;
+      else
+        usage ();
+      break;
+    case 'r':
+      rate = strtod (optarg, NULL);
+      break;
+    case 'l':
+      loops = (unsigned)strtoul (optarg, NULL, 10);
+      break;
+    case 't':
+      toolPath = optarg;
+      break;
+    default:
+      usage ();
+    }
+  }
+
+  if (!corpusFile || !loops)
+    usage ();
+
+  Corpus corpus = loadCorpus (corpusFile, binary);
+  if (!corpus.count) {
+    fprintf (stderr, "The corpus is empty.\n");
+    exit (1);
+  }
+
+  size_t runCount = corpus.count * loops;
+  uint64_t *latencies = reallocOrExit (NULL, runCount * sizeof (uint64_t));
+  uint64_t interval = rate > 0 ? (uint64_t)(1e9 / rate) : 0;
+  uint64_t start = now ();
+
+  for (size_t i = 0; i < runCount; ++i) {
+    uint64_t due = start + i * interval;
+    if (interval)
+      sleepUntil (due);
+    else
+      due = now ();
+
+    runOne (&corpus, i % corpus.count, mode, toolPath);
+    latencies[i] = now () - due;
+  }
+
+  double seconds = (now () - start) / 1e9;
+  qsort (latencies, runCount, sizeof (uint64_t), compareLatencies);
+
+  printf ("polylines: %zu (%zu points, %zu bytes encoded per loop)\n",
+          runCount, corpus.totalCoords, corpus.totalBytes);
+  printf ("time: %.3fs\n", seconds);
+  printf ("throughput: %.0f polylines/s, %.0f points/s, %.2f MB/s encoded\n",
+          runCount / seconds, corpus.totalCoords * loops / seconds,
+          corpus.totalBytes * loops / seconds / 1e6);
+  printf ("latency us: p50 %.2f, p99 %.2f, p999 %.2f, max %.2f\n",
+          percentile (latencies, runCount, 0.5),
+          percentile (latencies, runCount, 0.99),
+          percentile (latencies, runCount, 0.999),
+          latencies[runCount - 1] / 1000.0);
+
+  for (size_t i = 0; i < corpus.count; ++i) {
+    free (corpus.encoded[i]);
+    free (corpus.coords[i]);
+  }
+
+  free (corpus.encoded);
+  free (corpus.coords);
+  free (corpus.coordCounts);
+  free (latencies);
+  return 0;
+}
@@ -12,6 +12,8 @@
 #include <getopt.h>
 
 #include "polylineFunctions.h"
+#include "PolylinePipeline.h"
+#include "PolylineFormats.h"
 
 /* result is passed in as a pointer as it makes it easy to set it to NULL
    at the end of the file. */
@@ -41,19 +43,25 @@ bool nextLocation (FILE *in, Coordinate *result) {
 void encodeLocations (FILE *instream, FILE *outstream)
 {
   PolylineEncoder *encoder = PolylineEncoderCreate ();
-  char charBuffer[11];
+  char charBuffer[POLYLINE_MAX_COORDINATE_CHARS + 1];
   while (true) {
     Coordinate nextCoord;
     bool finished = nextLocation (instream, &nextCoord);
     if (finished) {
       /* Hey we're all done! let's return. */
       fprintf (outstream, "\n");
+      PolylineEncoderFree (encoder);
       return;
     } else {
       /* We've got a new coordinate to encode let's do that. */
       unsigned charCount = PolylineEncoderGetEncodedCoordinate (encoder,
                                                                  nextCoord,
                                                                  charBuffer);
+      if (!charCount) {
+        fprintf (stderr, "The coordinate %f, %f is out of range, so stopped.\n",
+                 nextCoord.latitude, nextCoord.longitude);
+        exit (1);
+      }
       
       charBuffer[charCount] = '\0';
       fprintf (outstream, "%s", charBuffer);
@@ -61,29 +69,63 @@ void encodeLocations (FILE *instream, FILE *outstream)
   }
 }
 
+/* Ends chars at the first character that can't be part of a polyline,
+   such as a new line, and returns true if there was one. The -j pipeline
+   stops at the same place. */
+static bool endAtStopChar (char *chars, unsigned *charsCount) {
+  for (unsigned i = 0; i < *charsCount; ++i) {
+    if (chars[i] < 63 || chars[i] > 126) {
+      chars[i] = '\0';
+      *charsCount = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
 void decodeLocations (FILE *instream, FILE *outstream) {
   PolylineEncoder *encoder = PolylineEncoderCreate ();
   char polylineChars[128];
   unsigned charsCount = fread (polylineChars, sizeof (char), 127, instream);
   polylineChars[charsCount] = '\0';
-  unsigned decodedCount;
+  bool stopped = endAtStopChar (polylineChars, &charsCount);
+  size_t decodedCount;
+  PolylineStatus status;
   
   do {
     Coordinate *decoded = PolylineEncoderGetDecodedCoordinates (encoder,
                                                                 polylineChars,
-                                                                &decodedCount);
+                                                                &decodedCount,
+                                                                &status);
     if (decodedCount) {
-      for (int i = 0; i < decodedCount; ++i) {
+      for (size_t i = 0; i < decodedCount; ++i) {
         fprintf (outstream, "%lf, %lf\n",
                  decoded[i].latitude, decoded[i].longitude);
       }
+
+      free (decoded);
+    }
+
+    if (status != PolylineStatusSuccess) {
+      fprintf (stderr, "The input isn't a valid polyline.\n");
+      exit (1);
     }
     
+    if (stopped) {
+      /* Anything after the stop, e.g. the lines after the first, isn't
+         decoded. */
+      fprintf (outstream, "\n");
+      PolylineEncoderFree (encoder);
+      return;
+    }
+
     if (charsCount < 127) {
       /* We've either ended or something has gone wrong!*/
       if (feof (instream)) {
         /* Great we got to the end of the file without any issues let's return. */
         fprintf (outstream, "\n");
+        PolylineEncoderFree (encoder);
         return;
       } else {
         fprintf (stderr, "Failed to read characters from the input stream.");
@@ -93,6 +135,7 @@ void decodeLocations (FILE *instream, FILE *outstream) {
 
     charsCount = fread (polylineChars, sizeof (char), 127, instream);
     polylineChars[charsCount] = '\0';
+    stopped = endAtStopChar (polylineChars, &charsCount);
   } while (true);
 }
 
@@ -120,7 +163,7 @@ bool strcicmp (char *a, char *b) {
 
 void usage () {
   printf ("PolylineTool: a tool for encoding and decoding Google Polylines.\n\n"
-          "PolylineTool [-ioadef?]\n"
+          "PolylineTool [-ioadefjF?]\n"
           "-i <FileName> Reads input from a file with FileName instead of stdin\n"
           "-o <FileName> Writes output to file instead of standard out. This "
           "won't automatically overwirte files if they already exist.\n"
@@ -130,7 +173,14 @@ void usage () {
           "-d Decode, used when you want to decode a polyline rather than encode "
           "coordinates.\n"
           "-e Encode, used to encode coordinates, this is the default so doesn't "
-          "need to be used.");
+          "need to be used.\n"
+          "-j <Threads> Reads, encodes/decodes and writes on separate threads, "
+          "using Threads threads to encode/decode. Useful for large inputs.\n"
+          "-F <Format> The format of the coordinates, read when encoding and "
+          "written when decoding: text (the default), geojson, wkb, ewkb, "
+          "hexwkb or hexewkb. GeoJSON and WKB LineStrings and "
+          "MultiLineStrings are encoded to one polyline per line, decoding "
+          "several lines of polylines gives a MultiLineString.\n");
           
   exit(1);
 }
@@ -145,8 +195,10 @@ int main (int argc, char **argv) {
   bool hadOpenFileArg = false;
   char *outputFileStr = NULL;
   bool decode = false;
+  unsigned workerCount = 0;
+  CoordinateFormat format = CoordinateFormatText;
   
-  while ((ch = getopt (argc, argv, "i:o:a:def")) != -1) {
+  while ((ch = getopt (argc, argv, "i:o:a:defj:F:")) != -1) {
     switch (ch) {
     case 'i':
       if (access (optarg, R_OK) == -1) {
@@ -205,6 +257,19 @@ int main (int argc, char **argv) {
       /* Forcefull overwrite output. */
       dontCareIfFileAlreadyExists = true;
       break;
+    case 'j':
+      workerCount = (unsigned)strtoul (optarg, NULL, 10);
+      if (!workerCount) {
+        fprintf (stderr, "-j needs a number of threads greater than 0.\n");
+        usage ();
+      }
+      break;
+    case 'F':
+      if (!coordinateFormatFromName (optarg, &format)) {
+        fprintf (stderr, "Unknown format %s.\n", optarg);
+        usage ();
+      }
+      break;
     case '?':
       usage ();
     }
@@ -248,7 +313,36 @@ int main (int argc, char **argv) {
     exit (1);
   }
 
-  if (decode) {
+  if (format != CoordinateFormatText) {
+    if (workerCount) {
+      fprintf (stderr, "-j only works with the text format.\n");
+      usage ();
+    }
+
+    if (decode)
+      formatDecodeLocations (input, output, format);
+    else
+      formatEncodeLocations (input, output, format);
+  } else if (workerCount) {
+    PolylineStatus status = decode
+                            ? pipelineDecodeLocations (input, output, workerCount)
+                            : pipelineEncodeLocations (input, output, workerCount);
+    if (status == PolylineStatusMalformedInput) {
+      fprintf (stderr, "Malformed input, so stopped.\n");
+      exit (1);
+    } else if (status == PolylineStatusInvalidArgument) {
+      fprintf (stderr, "A coordinate is out of range, so stopped.\n");
+      exit (1);
+    } else if (status != PolylineStatusSuccess) {
+      fprintf (stderr, "Couldn't allocate the threads and buffers for -j.\n");
+      exit (1);
+    }
+
+    if (ferror (input)) {
+      fprintf (stderr, "Failed to read characters from the input stream.");
+      exit (1);
+    }
+  } else if (decode) {
     decodeLocations (input, output);
   } else {
     encodeLocations (input, output);
@@ -0,0 +1,241 @@
+//
+//  polyline.hpp
+//  googlePolylineTest
+//
+//  constexpr versions of the polyline encoding and decoding for C++17, so
+//  fixed polylines (test fixtures, static overlays) can be decoded into
+//  coordinate tables, and fixed coordinates encoded into strings, by the
+//  compiler rather than at startup. The results are meant to be the same
+//  as copyEncodedLocationsString and decodeLocationsString. The
+//  static_asserts at the end of this file only check Google's example,
+//  googlePolylineTestTests/polylineHppTests.cpp compares them with the C
+//  functions. A malformed polyline given to POLYLINE_DECODE doesn't
+//  compile.
+//
+//    constexpr std::array<Coordinate, 2> route {{ { 38.5, -120.2 },
+//                                                 { 40.7, -120.95 } }};
+//    constexpr auto encoded = POLYLINE_ENCODE (route);  // encoded.data ()
+//    constexpr auto coords = POLYLINE_DECODE ("_p~iF~ps|U_ulLnnqC");
+//
+
+#ifndef googlePolylineTest_polyline_hpp
+#define googlePolylineTest_polyline_hpp
+
+#if __cplusplus < 201703L
+#error "polyline.hpp needs C++17 for constexpr std::array"
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include "polylineFunctions.h"
+
+/* Encodes a constexpr std::array of Coordinates to a NUL terminated
+   std::array of chars. */
+#define POLYLINE_ENCODE(coords) \
+  (::polyline::encode<::polyline::encodedLength (coords)> (coords))
+
+/* Decodes a string literal, or constexpr string, to a std::array of
+   Coordinates. */
+#define POLYLINE_DECODE(string) \
+  (::polyline::decode<::polyline::coordinateCount (string)> (string))
+
+namespace polyline {
+
+namespace detail {
+
+/* The same as round (value * 1e5), which isn't constexpr. Adding 0.5
+   then truncating isn't, 0.49999999999999994 + 0.5 rounds up to 1, but
+   the difference between a double and its truncation is exact. */
+constexpr int32_t toIntValue (double value)
+{
+  double scaled = value * 1e5;
+  int64_t truncated = static_cast<int64_t> (scaled);
+  double remainder = scaled - static_cast<double> (truncated);
+  if (remainder >= 0.5)
+    ++truncated;
+  else if (remainder <= -0.5)
+    --truncated;
+
+  return static_cast<int32_t> (truncated);
+}
+
+/* The difference with the sign moved to the lowest bit, as in
+   encodeIntValue. */
+constexpr uint32_t zigZag (int32_t intValue, int32_t previousIntValue)
+{
+  uint32_t difference = static_cast<uint32_t> (intValue)
+                        - static_cast<uint32_t> (previousIntValue);
+  bool isNeg = static_cast<int32_t> (difference) < 0;
+  difference <<= 1;
+  return isNeg ? ~difference : difference;
+}
+
+constexpr std::size_t valueLength (uint32_t value)
+{
+  std::size_t length = 1;
+  for (; value >= 0x20; value >>= 5)
+    ++length;
+
+  return length;
+}
+
+template <std::size_t Length>
+constexpr std::size_t writeValue (uint32_t value,
+                                  std::array<char, Length> &result,
+                                  std::size_t position)
+{
+  for (; value >= 0x20; value >>= 5)
+    result[position++] = static_cast<char> (((value & 0x1f) | 0x20) + 63);
+
+  result[position++] = static_cast<char> (value + 63);
+  return position;
+}
+
+/* Reads the value at string[position], the same as polylineReadValue.
+   Returns false if the value is incomplete. */
+constexpr bool readValue (const char *string, std::size_t &position,
+                          int32_t &intValue)
+{
+  std::size_t next = position;
+  uint32_t value = 0;
+  unsigned shift = 0;
+  int currentByte = 0;
+
+  do {
+    if (string[next] == '\0')
+      return false;
+
+    currentByte = string[next++] - 63;
+    if (shift < 32)
+      value |= static_cast<uint32_t> (currentByte & 0x1f) << shift;
+    shift += 5;
+  } while (currentByte & 0x20);
+
+  int32_t difference = static_cast<int32_t> (value >> 1);
+  if (value & 1)
+    difference = ~difference;
+
+  intValue = static_cast<int32_t> (static_cast<uint32_t> (intValue)
+                                   + static_cast<uint32_t> (difference));
+  position = next;
+  return true;
+}
+
+constexpr bool stringsEqual (const char *a, const char *b)
+{
+  for (; *a && *a == *b; ++a, ++b) {
+  }
+
+  return *a == *b;
+}
+
+} // namespace detail
+
+/* The number of characters coords encodes to, not including the NUL
+   terminator. */
+template <std::size_t N>
+constexpr std::size_t encodedLength (const std::array<Coordinate, N> &coords)
+{
+  std::size_t length = 0;
+  int32_t intLat = 0, intLng = 0;
+  for (const Coordinate &coord : coords) {
+    int32_t nextLat = detail::toIntValue (coord.latitude);
+    int32_t nextLng = detail::toIntValue (coord.longitude);
+    length += detail::valueLength (detail::zigZag (nextLat, intLat))
+              + detail::valueLength (detail::zigZag (nextLng, intLng));
+    intLat = nextLat;
+    intLng = nextLng;
+  }
+
+  return length;
+}
+
+/* Encodes coords, Length must be encodedLength (coords), which
+   POLYLINE_ENCODE passes. */
+template <std::size_t Length, std::size_t N>
+constexpr std::array<char, Length + 1>
+encode (const std::array<Coordinate, N> &coords)
+{
+  std::array<char, Length + 1> result {};
+  std::size_t position = 0;
+  int32_t intLat = 0, intLng = 0;
+  for (const Coordinate &coord : coords) {
+    int32_t nextLat = detail::toIntValue (coord.latitude);
+    int32_t nextLng = detail::toIntValue (coord.longitude);
+    position = detail::writeValue (detail::zigZag (nextLat, intLat), result,
+                                   position);
+    position = detail::writeValue (detail::zigZag (nextLng, intLng), result,
+                                   position);
+    intLat = nextLat;
+    intLng = nextLng;
+  }
+
+  result[position] = '\0';
+  return result;
+}
+
+/* The number of complete coordinates in the NUL terminated string, the
+   same count as decodeLocationsString gives. */
+constexpr std::size_t coordinateCount (const char *string)
+{
+  /* Every value ends with a character without the continuation bit. */
+  std::size_t valueCount = 0;
+  for (; *string; ++string)
+    valueCount += !((*string - 63) & 0x20);
+
+  return valueCount / 2;
+}
+
+/* Decodes the first N coordinates of string, N must be at most
+   coordinateCount (string), which POLYLINE_DECODE passes. Throws
+   std::invalid_argument if there aren't N coordinates, or one is longer
+   than POLYLINE_MAX_COORDINATE_CHARS, which decodeLocationsString
+   rejects. In a constant expression, e.g. from POLYLINE_DECODE, the
+   throw makes it a compile error instead. */
+template <std::size_t N>
+constexpr std::array<Coordinate, N> decode (const char *string)
+{
+  std::array<Coordinate, N> result {};
+  std::size_t position = 0;
+  int32_t intLat = 0, intLng = 0;
+  for (Coordinate &coord : result) {
+    std::size_t start = position;
+    if (!detail::readValue (string, position, intLat)
+        || !detail::readValue (string, position, intLng))
+      throw std::invalid_argument ("polyline has too few coordinates");
+    if (position - start > POLYLINE_MAX_COORDINATE_CHARS)
+      throw std::invalid_argument ("polyline coordinate is too long");
+
+    coord.latitude = intLat * 1e-5;
+    coord.longitude = intLng * 1e-5;
+  }
+
+  return result;
+}
+
+namespace detail {
+
+/* The example from Google's description of the format. */
+constexpr std::array<Coordinate, 3> exampleCoords {{ { 38.5, -120.2 },
+                                                     { 40.7, -120.95 },
+                                                     { 43.252, -126.453 } }};
+constexpr char exampleString[] = "_p~iF~ps|U_ulLnnqC_mqNvxq`@";
+
+static_assert (stringsEqual (POLYLINE_ENCODE (exampleCoords).data (),
+                             exampleString),
+               "constexpr encoding doesn't match copyEncodedLocationsString");
+static_assert (POLYLINE_DECODE (exampleString).size () == 3
+               && toIntValue (POLYLINE_DECODE (exampleString)[2].latitude)
+                  == 4325200
+               && toIntValue (POLYLINE_DECODE (exampleString)[2].longitude)
+                  == -12645300,
+               "constexpr decoding doesn't match decodeLocationsString");
+
+} // namespace detail
+
+} // namespace polyline
+
+#endif
@@ -0,0 +1,381 @@
+//
+//  polylineBatch.c
+//  googlePolylineTest
+//
+
+/* pthread_setaffinity_np and the CPU_* macros are GNU extensions,
+   elsewhere only pthreads are needed when compiling with -std=c99. */
+#ifdef __linux__
+#define _GNU_SOURCE
+#else
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "polylineBatch.h"
+#include "polylineVarint.h"
+
+/* The number of coordinates decoded to integers before they're converted
+   and written out. The integers (8KB) stay in the L1 cache, and splitting
+   the branchy character loop from the conversion lets the compiler
+   vectorise the conversion and write each column sequentially. */
+#define BATCH_BLOCK_SIZE 1024
+
+typedef struct BatchRange {
+  const char *const *encodedStrings;
+  size_t start;
+  size_t end;
+  /* When counting the number of coordinates in polyline i is written to
+     offsets[i + 1], when decoding these are the final offsets. */
+  size_t *offsets;
+  double *latitudes;
+  double *longitudes;
+  /* The CPU to pin the thread to, or -1 to leave it unpinned. */
+  int cpu;
+  bool onThread;
+  /* MalformedInput if any polyline in the range couldn't be decoded. */
+  PolylineStatus status;
+} BatchRange;
+
+static void pinToCpu (int cpu)
+{
+#ifdef __linux__
+  if (cpu < 0)
+    return;
+
+  cpu_set_t set;
+  CPU_ZERO (&set);
+  CPU_SET (cpu, &set);
+  /* If pinning fails the thread still works, it just might write to
+     memory on another node. */
+  pthread_setaffinity_np (pthread_self (), sizeof (set), &set);
+#else
+  (void)cpu;
+#endif
+}
+
+/* Gives each range a CPU, spreading them evenly over the CPUs the process
+   may run on. CPUs are usually numbered node by node, so this also
+   spreads the ranges over the NUMA nodes. */
+static void assignCpus (BatchRange *ranges, unsigned rangeCount)
+{
+  for (unsigned i = 0; i < rangeCount; ++i)
+    ranges[i].cpu = -1;
+
+#ifdef __linux__
+  cpu_set_t allowed;
+  if (sched_getaffinity (0, sizeof (allowed), &allowed))
+    return;
+
+  int cpus[CPU_SETSIZE];
+  unsigned cpuCount = 0;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET (cpu, &allowed))
+      cpus[cpuCount++] = cpu;
+  }
+
+  for (unsigned i = 0; cpuCount && i < rangeCount; ++i)
+    ranges[i].cpu = cpus[(size_t)i * cpuCount / rangeCount];
+#endif
+}
+
+static void *countRange (void *info)
+{
+  BatchRange *range = info;
+  pinToCpu (range->cpu);
+
+  for (size_t i = range->start; i < range->end; ++i) {
+    const char *encodedString = range->encodedStrings[i];
+    range->offsets[i + 1] = polylineCountValues (encodedString,
+                                                 strlen (encodedString)) / 2;
+  }
+
+  return NULL;
+}
+
+POLYLINE_VECTOR_KERNEL
+static void convertBlock (const int32_t *restrict intLats,
+                          const int32_t *restrict intLngs,
+                          double *restrict latitudes,
+                          double *restrict longitudes,
+                          unsigned count)
+{
+  for (unsigned j = 0; j < count; ++j) {
+    latitudes[j] = intLats[j] * 1e-5;
+    longitudes[j] = intLngs[j] * 1e-5;
+  }
+}
+
+/* Decodes polyline i of the range, returns false if it's malformed the
+   same way decodeLocationsString rejects it: a character outside '?' to
+   '~', a coordinate longer than POLYLINE_MAX_COORDINATE_CHARS, or more
+   than that many characters left over at the end. Also false if the
+   offsets didn't come from the polylines and there are fewer coordinates
+   than they say. */
+static bool decodePolyline (const BatchRange *range, size_t i,
+                            int32_t *restrict intLats,
+                            int32_t *restrict intLngs)
+{
+  const char *position = range->encodedStrings[i];
+  size_t length = strlen (position);
+  const char *end = position + length;
+  if (polylineCountBadChars (position, length))
+    return false;
+
+  size_t output = range->offsets[i];
+  size_t remaining = range->offsets[i + 1] - output;
+  int32_t intLat = 0;
+  int32_t intLng = 0;
+
+  while (remaining) {
+    unsigned blockCount = 0;
+    unsigned blockSize = remaining < BATCH_BLOCK_SIZE ? (unsigned)remaining
+                                                      : BATCH_BLOCK_SIZE;
+    const char *coordStart = position;
+    while (blockCount < blockSize
+           && polylineReadCoordinate (&position, NULL, &intLat, &intLng)
+           && position - coordStart <= POLYLINE_MAX_COORDINATE_CHARS) {
+      intLats[blockCount] = intLat;
+      intLngs[blockCount] = intLng;
+      ++blockCount;
+      coordStart = position;
+    }
+
+    if (blockCount < blockSize)
+      return false;
+
+    convertBlock (intLats, intLngs, range->latitudes + output,
+                  range->longitudes + output, blockCount);
+    output += blockCount;
+    remaining -= blockCount;
+  }
+
+  return (size_t)(end - position) <= POLYLINE_MAX_COORDINATE_CHARS;
+}
+
+static void *decodeRange (void *info)
+{
+  BatchRange *range = info;
+  pinToCpu (range->cpu);
+
+  int32_t intLats[BATCH_BLOCK_SIZE];
+  int32_t intLngs[BATCH_BLOCK_SIZE];
+
+  for (size_t i = range->start; i < range->end; ++i) {
+    if (decodePolyline (range, i, intLats, intLngs))
+      continue;
+
+    /* Nothing is left unwritten, a malformed polyline's coordinates are
+       all NaN. */
+    for (size_t j = range->offsets[i]; j < range->offsets[i + 1]; ++j) {
+      range->latitudes[j] = NAN;
+      range->longitudes[j] = NAN;
+    }
+
+    range->status = PolylineStatusMalformedInput;
+  }
+
+  return NULL;
+}
+
+/* Runs work over the ranges, each on its own thread if there's more than
+   one. The calling thread only waits, so that it doesn't have to be
+   pinned. */
+static void runRanges (BatchRange *ranges, unsigned rangeCount,
+                       void *(*work) (void *))
+{
+  if (rangeCount == 1) {
+    ranges[0].cpu = -1;
+    work (&ranges[0]);
+    return;
+  }
+
+  assignCpus (ranges, rangeCount);
+  /* Without the thread handles every range runs on the calling thread. */
+  pthread_t *threads = malloc (rangeCount * sizeof (pthread_t));
+  for (unsigned i = 0; i < rangeCount; ++i) {
+    ranges[i].onThread = threads
+                         && !pthread_create (&threads[i], NULL, work,
+                                             &ranges[i]);
+    if (!ranges[i].onThread) {
+      ranges[i].cpu = -1;
+      work (&ranges[i]);
+    }
+  }
+
+  for (unsigned i = 0; i < rangeCount; ++i) {
+    if (ranges[i].onThread)
+      pthread_join (threads[i], NULL);
+  }
+
+  free (threads);
+}
+
+static unsigned rangeCountFor (unsigned threadCount, size_t polylineCount)
+{
+  if (threadCount > polylineCount)
+    threadCount = (unsigned)polylineCount;
+
+  return threadCount ? threadCount : 1;
+}
+
+size_t PolylineBatchCountCoordinates (const char *const *encodedStrings,
+                                      size_t polylineCount,
+                                      unsigned threadCount,
+                                      size_t *offsets)
+{
+  unsigned rangeCount = rangeCountFor (threadCount, polylineCount);
+  BatchRange *ranges = malloc (rangeCount * sizeof (BatchRange));
+  BatchRange singleRange;
+  if (!ranges) {
+    ranges = &singleRange;
+    rangeCount = 1;
+  }
+
+  for (unsigned i = 0; i < rangeCount; ++i) {
+    ranges[i] = (BatchRange){ encodedStrings,
+                              polylineCount * i / rangeCount,
+                              polylineCount * (i + 1) / rangeCount,
+                              offsets, NULL, NULL, -1, false,
+                              PolylineStatusSuccess };
+  }
+
+  runRanges (ranges, rangeCount, countRange);
+  if (ranges != &singleRange)
+    free (ranges);
+
+  offsets[0] = 0;
+  for (size_t i = 0; i < polylineCount; ++i)
+    offsets[i + 1] += offsets[i];
+
+  return offsets[polylineCount];
+}
+
+/* Returns the first polyline whose coordinates start at or after
+   coordIndex. */
+static size_t polylineAt (const size_t *offsets, size_t polylineCount,
+                          size_t coordIndex)
+{
+  size_t low = 0;
+  size_t high = polylineCount;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (offsets[middle] < coordIndex)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return low;
+}
+
+PolylineStatus PolylineBatchDecodeInto (const char *const *encodedStrings,
+                                        size_t polylineCount,
+                                        const size_t *offsets,
+                                        unsigned threadCount,
+                                        double *latitudes,
+                                        double *longitudes)
+{
+  unsigned rangeCount = rangeCountFor (threadCount, polylineCount);
+  size_t coordCount = offsets[polylineCount];
+  BatchRange *ranges = malloc (rangeCount * sizeof (BatchRange));
+  BatchRange singleRange;
+  if (!ranges) {
+    ranges = &singleRange;
+    rangeCount = 1;
+  }
+
+  /* Split by coordinates rather than polylines so each thread writes
+     about the same amount. */
+  size_t start = 0;
+  for (unsigned i = 0; i < rangeCount; ++i) {
+    size_t end = i + 1 == rangeCount
+                 ? polylineCount
+                 : polylineAt (offsets, polylineCount,
+                               (size_t)((double)coordCount * (i + 1) / rangeCount));
+    ranges[i] = (BatchRange){ encodedStrings, start, end, (size_t *)offsets,
+                              latitudes, longitudes, -1, false,
+                              PolylineStatusSuccess };
+    start = end;
+  }
+
+  runRanges (ranges, rangeCount, decodeRange);
+
+  PolylineStatus status = PolylineStatusSuccess;
+  for (unsigned i = 0; i < rangeCount; ++i) {
+    if (ranges[i].status != PolylineStatusSuccess)
+      status = ranges[i].status;
+  }
+
+  if (ranges != &singleRange)
+    free (ranges);
+
+  return status;
+}
+
+PolylineBatch *PolylineBatchDecode (const char *const *encodedStrings,
+                                    size_t polylineCount,
+                                    unsigned threadCount,
+                                    PolylineStatus *status)
+{
+  if (status)
+    *status = PolylineStatusOutOfMemory;
+
+  /* The offsets are kept in the same allocation as the batch. */
+  PolylineBatch *batch = malloc (sizeof (PolylineBatch)
+                                 + (polylineCount + 1) * sizeof (size_t));
+  if (!batch)
+    return NULL;
+
+  batch->polylineCount = polylineCount;
+  batch->offsets = (size_t *)(batch + 1);
+  batch->coordCount = PolylineBatchCountCoordinates (encodedStrings,
+                                                     polylineCount,
+                                                     threadCount,
+                                                     batch->offsets);
+
+  /* Both columns are in one allocation. It isn't written to here, a large
+     allocation is fresh memory from the system, so its pages are placed
+     when the decoding threads first write to them. */
+  batch->latitudes = malloc ((batch->coordCount ? batch->coordCount : 1)
+                             * 2 * sizeof (double));
+  if (!batch->latitudes) {
+    free (batch);
+    return NULL;
+  }
+
+  batch->longitudes = batch->latitudes + batch->coordCount;
+  PolylineStatus result = PolylineBatchDecodeInto (encodedStrings,
+                                                   polylineCount,
+                                                   batch->offsets,
+                                                   threadCount,
+                                                   batch->latitudes,
+                                                   batch->longitudes);
+  if (status)
+    *status = result;
+
+  if (result != PolylineStatusSuccess) {
+    PolylineBatchFree (batch);
+    return NULL;
+  }
+
+  return batch;
+}
+
+void PolylineBatchFree (PolylineBatch *batch)
+{
+  if (!batch)
+    return;
+
+  free (batch->latitudes);
+  free (batch);
+}
@@ -0,0 +1,80 @@
+//
+//  polylineBatch.h
+//  googlePolylineTest
+//
+//  Decodes a large batch of polylines straight into one preallocated
+//  pair of latitude and longitude columns, spread across threads.
+//
+
+#ifndef googlePolylineTest_polylineBatch_h
+#define googlePolylineTest_polylineBatch_h
+
+#include <stddef.h>
+
+#include "polylineFunctions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A decoded batch, the coordinates of polyline i are at indices
+   offsets[i] to offsets[i + 1] - 1 of latitudes and longitudes. */
+typedef struct PolylineBatch {
+  size_t polylineCount;
+  size_t coordCount;
+  /* polylineCount + 1 entries, offsets[0] is 0. */
+  size_t *offsets;
+  double *latitudes;
+  double *longitudes;
+} PolylineBatch;
+
+/* Counts the coordinates in each of the NUL terminated polylines without
+   decoding them, by counting the characters that end a value. An
+   incomplete final coordinate isn't counted, the same as when decoding.
+   offsets: Must have room for polylineCount + 1 entries, offsets[i] is set
+            to the number of coordinates in the polylines before i.
+   threadCount: The number of threads to split the batch across, 0 or 1
+                counts on the calling thread.
+   return: The total number of coordinates, offsets[polylineCount]. */
+size_t PolylineBatchCountCoordinates (const char *const *encodedStrings,
+                                      size_t polylineCount,
+                                      unsigned threadCount,
+                                      size_t *offsets);
+
+/* Decodes the polylines into latitudes and longitudes, which must have
+   room for offsets[polylineCount] values each. offsets must be the ones
+   given by PolylineBatchCountCoordinates for the same polylines.
+   Each thread takes a contiguous run of polylines holding about the same
+   number of coordinates, so each thread writes its own part of the
+   output. On Linux the threads are pinned to CPUs spread evenly over the
+   ones the process may run on, so with output memory that hasn't been
+   written to yet each thread's part is placed on its own NUMA node when
+   the pages are first touched.
+   return: MalformedInput if any polyline is one decodeLocationsString
+           would reject, or has fewer coordinates than offsets say, the
+           coordinates of those polylines are set to NaN. The others are
+           still decoded. */
+PolylineStatus PolylineBatchDecodeInto (const char *const *encodedStrings,
+                                        size_t polylineCount,
+                                        const size_t *offsets,
+                                        unsigned threadCount,
+                                        double *latitudes,
+                                        double *longitudes);
+
+/* Counts then decodes the polylines, making a single allocation for the
+   coordinates once the exact count is known. Returns NULL if the memory
+   couldn't be allocated or any polyline is malformed. Free the result
+   with PolylineBatchFree.
+   status: Set to why NULL was returned, may be NULL. */
+PolylineBatch *PolylineBatchDecode (const char *const *encodedStrings,
+                                    size_t polylineCount,
+                                    unsigned threadCount,
+                                    PolylineStatus *status);
+
+void PolylineBatchFree (PolylineBatch *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
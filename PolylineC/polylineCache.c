@@ -0,0 +1,409 @@
+//
+//  polylineCache.c
+//  googlePolylineTest
+//
+
+/* Needed for pthreads when compiling with -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "polylineCache.h"
+#include "polylineVarint.h"
+
+#define DEFAULT_SHARD_COUNT 16
+#define MAX_SHARD_COUNT 1024
+#define INITIAL_BUCKET_COUNT 16
+
+/* Each entry is a single allocation, the header is followed by the
+   coordinates then a copy of the encoded string, which is compared on a
+   lookup so two strings with the same hash can't be confused. */
+struct PolylineCacheEntry {
+  uint64_t hash;
+  /* One reference is held by the cache while the entry is in it. */
+  size_t refCount;
+  size_t coordCount;
+  size_t length;
+  /* The bytes counted against the cache's budget. */
+  size_t size;
+  PolylineCacheEntry *nextInBucket;
+  /* The shard's recently used list. */
+  PolylineCacheEntry *newer;
+  PolylineCacheEntry *older;
+  Coordinate coordinates[];
+};
+
+typedef struct CacheShard {
+  pthread_mutex_t lock;
+  PolylineCacheEntry **buckets;
+  size_t bucketCount;
+  PolylineCacheEntry *newest;
+  PolylineCacheEntry *oldest;
+  size_t maxBytes;
+  PolylineCacheStats stats;
+  /* Keeps each shard's lock and counters off its neighbours' cache lines. */
+  char padding[64];
+} CacheShard;
+
+struct PolylineCache {
+  unsigned shardCount;
+  CacheShard shards[];
+};
+
+static inline uint64_t mixWord (uint64_t hash, const char *bytes)
+{
+  uint64_t word;
+  memcpy (&word, bytes, sizeof (word));
+  hash = (hash ^ word) * 0xbf58476d1ce4e5b9u;
+  return hash ^ (hash >> 31);
+}
+
+/* A 64 bit hash that takes 8 characters at a time, the multiplies and
+   shifts are from splitmix64. Long strings are split over four running
+   hashes so the multiplies don't all wait on each other. */
+static uint64_t hashBytes (const char *bytes, size_t length)
+{
+  uint64_t hash = 0x9e3779b97f4a7c15u ^ length;
+  size_t i = 0;
+  if (length >= 32) {
+    uint64_t lanes[4] = { hash, hash + 1, hash + 2, hash + 3 };
+    for (; i + 32 <= length; i += 32) {
+      for (unsigned lane = 0; lane < 4; ++lane)
+        lanes[lane] = mixWord (lanes[lane], bytes + i + 8 * lane);
+    }
+
+    hash = lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7);
+  }
+
+  for (; i + 8 <= length; i += 8)
+    hash = mixWord (hash, bytes + i);
+
+  uint64_t tail = 0;
+  memcpy (&tail, bytes + i, length - i);
+  hash = (hash ^ tail) * 0x94d049bb133111ebu;
+  hash ^= hash >> 29;
+  hash *= 0xbf58476d1ce4e5b9u;
+  return hash ^ (hash >> 32);
+}
+
+static const char *entryString (const PolylineCacheEntry *entry)
+{
+  return (const char *)(entry->coordinates + entry->coordCount);
+}
+
+PolylineCache *PolylineCacheCreate (size_t maxBytes, unsigned shardCount)
+{
+  if (!shardCount)
+    shardCount = DEFAULT_SHARD_COUNT;
+  if (shardCount > MAX_SHARD_COUNT)
+    shardCount = MAX_SHARD_COUNT;
+
+  unsigned roundedCount = 1;
+  while (roundedCount < shardCount)
+    roundedCount *= 2;
+
+  PolylineCache *cache = calloc (1, sizeof (PolylineCache)
+                                    + roundedCount * sizeof (CacheShard));
+  if (!cache)
+    return NULL;
+
+  cache->shardCount = roundedCount;
+  for (unsigned i = 0; i < roundedCount; ++i) {
+    CacheShard *shard = &cache->shards[i];
+    shard->bucketCount = INITIAL_BUCKET_COUNT;
+    shard->buckets = calloc (shard->bucketCount, sizeof (PolylineCacheEntry *));
+    shard->maxBytes = maxBytes / roundedCount;
+    pthread_mutex_init (&shard->lock, NULL);
+    if (!shard->buckets) {
+      cache->shardCount = i + 1;
+      PolylineCacheFree (cache);
+      return NULL;
+    }
+  }
+
+  return cache;
+}
+
+void PolylineCacheFree (PolylineCache *cache)
+{
+  for (unsigned i = 0; i < cache->shardCount; ++i) {
+    CacheShard *shard = &cache->shards[i];
+    PolylineCacheEntry *entry = shard->newest;
+    while (entry) {
+      PolylineCacheEntry *older = entry->older;
+      PolylineCacheEntryRelease (entry);
+      entry = older;
+    }
+
+    pthread_mutex_destroy (&shard->lock);
+    free (shard->buckets);
+  }
+
+  free (cache);
+}
+
+static CacheShard *shardFor (PolylineCache *cache, uint64_t hash)
+{
+  /* The low bits pick the bucket, so use the high ones for the shard. */
+  return &cache->shards[(hash >> 40) & (cache->shardCount - 1)];
+}
+
+/* The functions below must be called with the shard locked. */
+
+static PolylineCacheEntry *findEntry (CacheShard *shard, uint64_t hash,
+                                      const char *encodedString,
+                                      size_t length)
+{
+  PolylineCacheEntry *entry = shard->buckets[hash & (shard->bucketCount - 1)];
+  for (; entry; entry = entry->nextInBucket) {
+    if (entry->hash == hash && entry->length == length
+        && !memcmp (entryString (entry), encodedString, length))
+      return entry;
+  }
+
+  return NULL;
+}
+
+static void unlinkFromList (CacheShard *shard, PolylineCacheEntry *entry)
+{
+  if (entry->newer)
+    entry->newer->older = entry->older;
+  else
+    shard->newest = entry->older;
+
+  if (entry->older)
+    entry->older->newer = entry->newer;
+  else
+    shard->oldest = entry->newer;
+}
+
+static void pushNewest (CacheShard *shard, PolylineCacheEntry *entry)
+{
+  entry->newer = NULL;
+  entry->older = shard->newest;
+  if (shard->newest)
+    shard->newest->newer = entry;
+  else
+    shard->oldest = entry;
+
+  shard->newest = entry;
+}
+
+/* Doubles the number of buckets, if that fails the chains just get
+   longer. */
+static void growBuckets (CacheShard *shard)
+{
+  size_t bucketCount = shard->bucketCount * 2;
+  PolylineCacheEntry **buckets = calloc (bucketCount,
+                                         sizeof (PolylineCacheEntry *));
+  if (!buckets)
+    return;
+
+  for (PolylineCacheEntry *entry = shard->newest; entry; entry = entry->older) {
+    size_t bucket = entry->hash & (bucketCount - 1);
+    entry->nextInBucket = buckets[bucket];
+    buckets[bucket] = entry;
+  }
+
+  free (shard->buckets);
+  shard->buckets = buckets;
+  shard->bucketCount = bucketCount;
+}
+
+static void removeEntry (CacheShard *shard, PolylineCacheEntry *entry)
+{
+  PolylineCacheEntry **link = &shard->buckets[entry->hash
+                                              & (shard->bucketCount - 1)];
+  while (*link != entry)
+    link = &(*link)->nextInBucket;
+
+  *link = entry->nextInBucket;
+  unlinkFromList (shard, entry);
+  --shard->stats.entryCount;
+  shard->stats.byteCount -= entry->size;
+}
+
+static void insertEntry (CacheShard *shard, PolylineCacheEntry *entry)
+{
+  while (shard->stats.byteCount + entry->size > shard->maxBytes) {
+    PolylineCacheEntry *oldest = shard->oldest;
+    removeEntry (shard, oldest);
+    ++shard->stats.evictions;
+    PolylineCacheEntryRelease (oldest);
+  }
+
+  if (shard->stats.entryCount >= shard->bucketCount)
+    growBuckets (shard);
+
+  size_t bucket = entry->hash & (shard->bucketCount - 1);
+  entry->nextInBucket = shard->buckets[bucket];
+  shard->buckets[bucket] = entry;
+  pushNewest (shard, entry);
+  ++shard->stats.entryCount;
+  shard->stats.byteCount += entry->size;
+}
+
+/* Decodes the polyline into a new entry with one reference. */
+static PolylineCacheEntry *createEntry (uint64_t hash,
+                                        const char *encodedString,
+                                        size_t length,
+                                        PolylineStatus *status)
+{
+  /* Counting the values first means the coordinates, and the entry, can
+     be a single allocation of the right size. */
+  if (polylineCountBadChars (encodedString, length)) {
+    *status = PolylineStatusMalformedInput;
+    return NULL;
+  }
+
+  size_t coordCount = polylineCountValues (encodedString, length) / 2;
+  size_t size = sizeof (PolylineCacheEntry) + coordCount * sizeof (Coordinate)
+                + length + 1;
+  PolylineCacheEntry *entry = malloc (size);
+  if (!entry) {
+    *status = PolylineStatusOutOfMemory;
+    return NULL;
+  }
+
+  const char *position = encodedString;
+  const char *end = encodedString + length;
+  int32_t intLat = 0, intLng = 0;
+  const char *coordStart = position;
+  size_t decodedCount = 0;
+  while (decodedCount < coordCount
+         && polylineReadCoordinate (&position, end, &intLat, &intLng)) {
+    /* decodeLocationsString doesn't decode a coordinate longer than this,
+       so stop before it and it's counted as bad input below. */
+    if (position - coordStart > POLYLINE_MAX_COORDINATE_CHARS) {
+      position = coordStart;
+      break;
+    }
+
+    entry->coordinates[decodedCount].latitude = intLat * 1e-5;
+    entry->coordinates[decodedCount].longitude = intLng * 1e-5;
+    ++decodedCount;
+    coordStart = position;
+  }
+
+  /* Decoding only stops early at the end of the string, anything longer
+     than a coordinate that couldn't be decoded is bad input. */
+  if ((size_t)(end - position) > POLYLINE_MAX_COORDINATE_CHARS) {
+    free (entry);
+    *status = PolylineStatusMalformedInput;
+    return NULL;
+  }
+
+  entry->hash = hash;
+  entry->refCount = 1;
+  entry->coordCount = decodedCount;
+  entry->length = length;
+  entry->size = size;
+  char *string = (char *)entryString (entry);
+  memcpy (string, encodedString, length);
+  string[length] = '\0';
+  return entry;
+}
+
+const PolylineCacheEntry *PolylineCacheDecode (PolylineCache *cache,
+                                               const char *encodedString,
+                                               size_t length,
+                                               PolylineStatus *status)
+{
+  PolylineStatus ignoredStatus;
+  if (!status)
+    status = &ignoredStatus;
+
+  if (!cache || !encodedString) {
+    *status = PolylineStatusInvalidArgument;
+    return NULL;
+  }
+
+  *status = PolylineStatusSuccess;
+  uint64_t hash = hashBytes (encodedString, length);
+  CacheShard *shard = shardFor (cache, hash);
+
+  pthread_mutex_lock (&shard->lock);
+  PolylineCacheEntry *entry = findEntry (shard, hash, encodedString, length);
+  if (entry) {
+    ++shard->stats.hits;
+    __atomic_add_fetch (&entry->refCount, 1, __ATOMIC_RELAXED);
+    unlinkFromList (shard, entry);
+    pushNewest (shard, entry);
+    pthread_mutex_unlock (&shard->lock);
+    return entry;
+  }
+
+  ++shard->stats.misses;
+  pthread_mutex_unlock (&shard->lock);
+
+  /* Decode without holding the lock so other polylines in the shard
+     aren't held up. */
+  PolylineCacheEntry *newEntry = createEntry (hash, encodedString, length,
+                                              status);
+  if (!newEntry || newEntry->size > shard->maxBytes)
+    return newEntry;
+
+  pthread_mutex_lock (&shard->lock);
+  /* Another thread may have added the same polyline while this one was
+     decoding it. */
+  entry = findEntry (shard, hash, encodedString, length);
+  if (entry) {
+    __atomic_add_fetch (&entry->refCount, 1, __ATOMIC_RELAXED);
+  } else {
+    entry = newEntry;
+    newEntry = NULL;
+    entry->refCount = 2;
+    insertEntry (shard, entry);
+  }
+
+  pthread_mutex_unlock (&shard->lock);
+  free (newEntry);
+  return entry;
+}
+
+const Coordinate *PolylineCacheEntryCoordinates (const PolylineCacheEntry *entry,
+                                                 size_t *coordCount)
+{
+  *coordCount = entry->coordCount;
+  return entry->coordinates;
+}
+
+const PolylineCacheEntry *PolylineCacheEntryRetain (const PolylineCacheEntry *entry)
+{
+  __atomic_add_fetch (&((PolylineCacheEntry *)entry)->refCount, 1,
+                      __ATOMIC_RELAXED);
+  return entry;
+}
+
+void PolylineCacheEntryRelease (const PolylineCacheEntry *entry)
+{
+  if (!entry)
+    return;
+
+  /* The release ordering makes this thread's reads of the entry happen
+     before another thread frees it. */
+  if (!__atomic_sub_fetch (&((PolylineCacheEntry *)entry)->refCount, 1,
+                           __ATOMIC_ACQ_REL))
+    free ((PolylineCacheEntry *)entry);
+}
+
+PolylineCacheStats PolylineCacheGetStats (PolylineCache *cache)
+{
+  PolylineCacheStats stats = { 0, 0, 0, 0, 0 };
+  for (unsigned i = 0; i < cache->shardCount; ++i) {
+    CacheShard *shard = &cache->shards[i];
+    pthread_mutex_lock (&shard->lock);
+    stats.hits += shard->stats.hits;
+    stats.misses += shard->stats.misses;
+    stats.evictions += shard->stats.evictions;
+    stats.entryCount += shard->stats.entryCount;
+    stats.byteCount += shard->stats.byteCount;
+    pthread_mutex_unlock (&shard->lock);
+  }
+
+  return stats;
+}
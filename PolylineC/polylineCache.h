@@ -0,0 +1,88 @@
+//
+//  polylineCache.h
+//  googlePolylineTest
+//
+//  A thread safe cache of decoded polylines for code that decodes the same
+//  strings over and over, e.g. a server handing out popular routes. The
+//  decoded coordinates are shared, every thread that asks for the same
+//  string gets a pointer to the same immutable buffer.
+//
+
+#ifndef googlePolylineTest_polylineCache_h
+#define googlePolylineTest_polylineCache_h
+
+#include <stddef.h>
+
+#include "polylineFunctions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct PolylineCache;
+typedef struct PolylineCache PolylineCache;
+
+/* A decoded polyline. Entries are reference counted, each one returned by
+   PolylineCacheDecode or PolylineCacheEntryRetain must be released with
+   PolylineCacheEntryRelease, and stays valid until then even if it has
+   been evicted from the cache. */
+struct PolylineCacheEntry;
+typedef struct PolylineCacheEntry PolylineCacheEntry;
+
+typedef struct PolylineCacheStats
+{
+  /* Decodes that found the polyline in the cache. */
+  size_t hits;
+  /* Decodes that had to decode the polyline. */
+  size_t misses;
+  /* Entries dropped to stay within the byte budget. */
+  size_t evictions;
+  size_t entryCount;
+  /* The bytes used by the entries in the cache, counted against maxBytes. */
+  size_t byteCount;
+} PolylineCacheStats;
+
+/* Creates an empty cache.
+   maxBytes: The most memory the cached entries may use, including the
+             coordinates and a copy of each encoded string. When it's
+             exceeded the least recently used entries are evicted.
+   shardCount: The number of independently locked parts the cache is split
+               into, rounded up to a power of 2. Each has an equal share
+               of maxBytes, polylines too big for a share are decoded but
+               not cached. 0 uses 16.
+   Returns NULL if the cache couldn't be allocated. */
+PolylineCache *PolylineCacheCreate (size_t maxBytes, unsigned shardCount);
+
+/* Frees the cache. No thread may use the cache during or after this call,
+   entries that haven't been released yet stay valid until they are. */
+void PolylineCacheFree (PolylineCache *cache);
+
+/* Returns the decoded coordinates of the first length characters of
+   encodedString, from the cache if they're there, otherwise they're
+   decoded and added to the cache. An incomplete final coordinate is
+   ignored, the same as decodeLocationsString.
+   status: Set to why NULL was returned, may be NULL.
+   return: The entry, which must be released, or NULL if the polyline is
+           malformed or the memory couldn't be allocated. */
+const PolylineCacheEntry *PolylineCacheDecode (PolylineCache *cache,
+                                               const char *encodedString,
+                                               size_t length,
+                                               PolylineStatus *status);
+
+/* The entry's coordinates, which must not be changed. */
+const Coordinate *PolylineCacheEntryCoordinates (const PolylineCacheEntry *entry,
+                                                 size_t *coordCount);
+
+/* Takes another reference to the entry, e.g. to hand it to another thread. */
+const PolylineCacheEntry *PolylineCacheEntryRetain (const PolylineCacheEntry *entry);
+
+void PolylineCacheEntryRelease (const PolylineCacheEntry *entry);
+
+/* The totals for all of the cache's shards. */
+PolylineCacheStats PolylineCacheGetStats (PolylineCache *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,214 @@
+//
+//  polylineDimensions.c
+//  googlePolylineTest
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "polylineDimensions.h"
+#include "polylineVarint.h"
+
+static const double powersOfTen[POLYLINE_MAX_PRECISION + 1] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10
+};
+
+/* Multiplying by these rather than dividing by powersOfTen gives the same
+   results as decodeLocationsString for precision 5. */
+static const double inversePowersOfTen[POLYLINE_MAX_PRECISION + 1] = {
+  1e-0, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8, 1e-9, 1e-10
+};
+
+struct PolylineDimensionEncoder {
+  unsigned dimensionCount;
+  double scales[POLYLINE_MAX_DIMENSIONS];
+  int64_t previousIntValues[POLYLINE_MAX_DIMENSIONS];
+};
+
+static bool dimensionsAreValid (unsigned dimensionCount,
+                                const unsigned *precisions)
+{
+  if (!dimensionCount || dimensionCount > POLYLINE_MAX_DIMENSIONS)
+    return false;
+
+  for (unsigned i = 0; i < dimensionCount; ++i) {
+    if (precisions[i] > POLYLINE_MAX_PRECISION)
+      return false;
+  }
+
+  return true;
+}
+
+PolylineDimensionEncoder *PolylineDimensionEncoderCreate (unsigned dimensionCount,
+                                                          const unsigned *precisions)
+{
+  if (!dimensionsAreValid (dimensionCount, precisions))
+    return NULL;
+
+  PolylineDimensionEncoder *encoder = calloc (1, sizeof (PolylineDimensionEncoder));
+  if (!encoder)
+    return NULL;
+
+  encoder->dimensionCount = dimensionCount;
+  for (unsigned i = 0; i < dimensionCount; ++i)
+    encoder->scales[i] = powersOfTen[precisions[i]];
+
+  return encoder;
+}
+
+void PolylineDimensionEncoderFree (PolylineDimensionEncoder *encoder)
+{
+  free (encoder);
+}
+
+/* The largest scaled value that's encoded, any two values within it
+   have a difference that fits in an int64_t. */
+#define MAX_SCALED_VALUE 0x1p62
+
+/* Returns 0, writing nothing, if a scaled value isn't finite or is
+   MAX_SCALED_VALUE or more from 0, as it can't be converted to an
+   int64_t difference. */
+static inline unsigned encodePoint (const double *scales,
+                                    int64_t *previousIntValues,
+                                    unsigned dimensionCount,
+                                    const double *const *columns,
+                                    size_t index,
+                                    char *result)
+{
+  int64_t intValues[POLYLINE_MAX_DIMENSIONS];
+  for (unsigned d = 0; d < dimensionCount; ++d) {
+    double scaled = round (columns[d][index] * scales[d]);
+    if (!(fabs (scaled) < MAX_SCALED_VALUE))
+      return 0;
+
+    intValues[d] = (int64_t)scaled;
+  }
+
+  unsigned count = 0;
+  for (unsigned d = 0; d < dimensionCount; ++d) {
+    count += polylineWriteWideValue (intValues[d] - previousIntValues[d],
+                                     result + count);
+    previousIntValues[d] = intValues[d];
+  }
+
+  return count;
+}
+
+unsigned PolylineDimensionEncoderGetEncodedPoint (PolylineDimensionEncoder *encoder,
+                                                  const double *values,
+                                                  char *result)
+{
+  /* Treat each value as a column with one entry. */
+  const double *columns[POLYLINE_MAX_DIMENSIONS];
+  for (unsigned d = 0; d < encoder->dimensionCount; ++d)
+    columns[d] = values + d;
+
+  return encodePoint (encoder->scales, encoder->previousIntValues,
+                      encoder->dimensionCount, columns, 0, result);
+}
+
+char *copyEncodedDimensionsString (const double *const *columns,
+                                   unsigned dimensionCount,
+                                   const unsigned *precisions,
+                                   size_t pointCount)
+{
+  if (!dimensionsAreValid (dimensionCount, precisions))
+    return NULL;
+
+  double scales[POLYLINE_MAX_DIMENSIONS];
+  int64_t previousIntValues[POLYLINE_MAX_DIMENSIONS] = { 0 };
+  for (unsigned d = 0; d < dimensionCount; ++d)
+    scales[d] = powersOfTen[precisions[d]];
+
+  unsigned maxPointLength = dimensionCount * POLYLINE_MAX_CHARS_PER_VALUE;
+  /* Guess about 3 characters per value, and grow the buffer if needed. */
+  size_t resultLength = (size_t)3 * dimensionCount * pointCount + maxPointLength + 1;
+  size_t resultCount = 0;
+  char *result = malloc (resultLength);
+  if (!result)
+    return NULL;
+
+  for (size_t i = 0; i < pointCount; ++i) {
+    if (resultLength - resultCount <= maxPointLength) {
+      resultLength = resultLength * 3 / 2 + maxPointLength;
+      char *larger = realloc (result, resultLength);
+      if (!larger) {
+        free (result);
+        return NULL;
+      }
+
+      result = larger;
+    }
+
+    unsigned pointLength = encodePoint (scales, previousIntValues,
+                                        dimensionCount, columns, i,
+                                        result + resultCount);
+    if (!pointLength) {
+      free (result);
+      return NULL;
+    }
+
+    resultCount += pointLength;
+  }
+
+  result[resultCount] = '\0';
+  /* Shrinking can't lose the string, keep the larger block if it fails. */
+  char *shrunk = realloc (result, resultCount + 1);
+  return shrunk ? shrunk : result;
+}
+
+double *decodeDimensionsString (const char *polylineString,
+                                unsigned dimensionCount,
+                                const unsigned *precisions,
+                                size_t *pointCount)
+{
+  *pointCount = 0;
+  if (!dimensionsAreValid (dimensionCount, precisions))
+    return NULL;
+
+  /* Every value ends with a character without the continuation bit set,
+     so counting those tells us exactly how much space the result needs. */
+  size_t valueCount = polylineCountValues (polylineString,
+                                           strlen (polylineString));
+
+  size_t count = valueCount / dimensionCount;
+  if (!count)
+    return NULL;
+
+  double *result = malloc (count * dimensionCount * sizeof (double));
+  if (!result)
+    return NULL;
+
+  double inverseScales[POLYLINE_MAX_DIMENSIONS];
+  int64_t intValues[POLYLINE_MAX_DIMENSIONS] = { 0 };
+  for (unsigned d = 0; d < dimensionCount; ++d)
+    inverseScales[d] = inversePowersOfTen[precisions[d]];
+
+  const char *position = polylineString;
+  for (size_t i = 0; i < count; ++i) {
+    for (unsigned d = 0; d < dimensionCount; ++d) {
+      uint64_t value = 0;
+      unsigned shift = 0;
+      int currentByte;
+      do {
+        currentByte = *position++ - 63;
+        if (shift < 64)
+          value |= (uint64_t)(currentByte & 0x1f) << shift;
+        shift += 5;
+      } while (currentByte & 0x20);
+
+      int64_t diff = (int64_t)(value >> 1);
+      if (value & 1)
+        diff = ~diff;
+
+      intValues[d] = (int64_t)((uint64_t)intValues[d] + (uint64_t)diff);
+      result[(size_t)d * count + i] = intValues[d] * inverseScales[d];
+    }
+  }
+
+  *pointCount = count;
+  return result;
+}
@@ -0,0 +1,85 @@
+//
+//  polylineDimensions.h
+//  googlePolylineTest
+//
+//  Encodes and decodes polylines whose points have more than a latitude
+//  and longitude, e.g. latitude, longitude, elevation and time. Each point
+//  is stored as its dimensions' values one after the other, each dimension
+//  has its own precision and is delta encoded against the same dimension
+//  of the previous point.
+//  With two dimensions at precision 5 the result is an ordinary polyline.
+//
+
+#ifndef googlePolylineTest_polylineDimensions_h
+#define googlePolylineTest_polylineDimensions_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The most dimensions a point can have. */
+#define POLYLINE_MAX_DIMENSIONS 8
+
+/* The largest precision (number of decimal places) a dimension can have. */
+#define POLYLINE_MAX_PRECISION 10
+
+/* Values are stored as 64 bit integers, so encoding a single value can
+   take up to 13 characters. */
+#define POLYLINE_MAX_CHARS_PER_VALUE 13
+
+struct PolylineDimensionEncoder;
+typedef struct PolylineDimensionEncoder PolylineDimensionEncoder;
+
+/* Creates an encoder for points with dimensionCount values.
+   precisions: The number of decimal places kept for each dimension, 5 is
+               what is used for the latitude and longitude of a polyline.
+   Returns NULL if dimensionCount is 0 or more than POLYLINE_MAX_DIMENSIONS,
+   a precision is more than POLYLINE_MAX_PRECISION, or the memory couldn't
+   be allocated. */
+PolylineDimensionEncoder *PolylineDimensionEncoderCreate (unsigned dimensionCount,
+                                                          const unsigned *precisions);
+
+void PolylineDimensionEncoderFree (PolylineDimensionEncoder *encoder);
+
+/* Encodes a point continuing on from the last point encoded.
+   values: dimensionCount values, in the order the precisions were given.
+   result: Must have room for dimensionCount * POLYLINE_MAX_CHARS_PER_VALUE
+           characters.
+   returns the number of characters written to result, or 0 if a value
+   isn't finite or is 2^62 or more from 0 once multiplied by
+   10^precision. Nothing is written then and the point is skipped, the
+   next point continues on from the one before it. */
+unsigned PolylineDimensionEncoderGetEncodedPoint (PolylineDimensionEncoder *encoder,
+                                                  const double *values,
+                                                  char *result);
+
+/* Encodes all of the points in one pass.
+   columns: dimensionCount arrays each holding pointCount values.
+   Returns the encoded C string, or NULL if the dimensions aren't valid
+   (see PolylineDimensionEncoderCreate), a value can't be encoded (see
+   PolylineDimensionEncoderGetEncodedPoint) or the memory couldn't be
+   allocated. */
+char *copyEncodedDimensionsString (const double *const *columns,
+                                   unsigned dimensionCount,
+                                   const unsigned *precisions,
+                                   size_t pointCount);
+
+/* Decodes a polyline with dimensionCount values per point.
+   pointCount: Set to the number of points decoded, an incomplete point at
+               the end of the string is ignored.
+   return: A single block holding one column per dimension, the values
+           of dimension d are at result + d * *pointCount. Free it with
+           free (). Returns NULL if there were no points, the dimensions
+           aren't valid or the memory couldn't be allocated. */
+double *decodeDimensionsString (const char *polylineString,
+                                unsigned dimensionCount,
+                                const unsigned *precisions,
+                                size_t *pointCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
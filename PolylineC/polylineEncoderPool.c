@@ -0,0 +1,236 @@
+//
+//  polylineEncoderPool.c
+//  googlePolylineTest
+//
+
+/* Needed for pthreads when compiling with -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "polylineEncoderPool.h"
+
+/* The number of released encoders each thread keeps for itself. */
+#define THREAD_CACHE_SIZE 4
+
+typedef struct ThreadCache ThreadCache;
+
+struct ThreadCache {
+  PolylineEncoderPool *pool;
+  PolylineEncoder *encoders[THREAD_CACHE_SIZE];
+  unsigned encoderCount;
+  /* Only changed by the cache's own thread, they're read and written
+     atomically so PolylineEncoderPoolGetStats can read them. */
+  size_t hits;
+  size_t misses;
+  size_t discards;
+  /* All of a pool's thread caches are linked together so the pool can
+     free them. */
+  ThreadCache *previous;
+  ThreadCache *next;
+};
+
+struct PolylineEncoderPool {
+  pthread_mutex_t lock;
+  pthread_key_t threadCacheKey;
+  size_t maxRetainedBytes;
+
+  /* The shared encoders, protected by lock. */
+  PolylineEncoder **encoders;
+  unsigned encoderCount;
+  unsigned maxPooledEncoders;
+
+  ThreadCache *threadCaches;
+  /* The stats of threads that have exited. */
+  PolylineEncoderPoolStats retiredStats;
+};
+
+static inline void increment (size_t *counter)
+{
+  __atomic_store_n (counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+/* Puts encoder in the shared part of the pool, or frees it if the pool
+   is full. Must be called with the pool locked. Returns false if the
+   encoder was freed. */
+static bool PolylineEncoderPoolAddShared (PolylineEncoderPool *pool,
+                                          PolylineEncoder *encoder)
+{
+  if (pool->encoderCount == pool->maxPooledEncoders) {
+    PolylineEncoderFree (encoder);
+    return false;
+  }
+
+  pool->encoders[pool->encoderCount++] = encoder;
+  return true;
+}
+
+/* Removes a thread cache from the pool, moving its encoders to the
+   shared part of the pool. Must be called with the pool locked. */
+static void ThreadCacheRetire (ThreadCache *cache)
+{
+  PolylineEncoderPool *pool = cache->pool;
+  for (unsigned i = 0; i < cache->encoderCount; ++i) {
+    if (!PolylineEncoderPoolAddShared (pool, cache->encoders[i]))
+      ++cache->discards;
+  }
+
+  pool->retiredStats.hits += cache->hits;
+  pool->retiredStats.misses += cache->misses;
+  pool->retiredStats.discards += cache->discards;
+
+  if (cache->previous)
+    cache->previous->next = cache->next;
+  else
+    pool->threadCaches = cache->next;
+
+  if (cache->next)
+    cache->next->previous = cache->previous;
+
+  free (cache);
+}
+
+/* Called by pthreads when a thread that used the pool exits. */
+static void ThreadCacheDestroy (void *info)
+{
+  ThreadCache *cache = info;
+  PolylineEncoderPool *pool = cache->pool;
+  pthread_mutex_lock (&pool->lock);
+  ThreadCacheRetire (cache);
+  pthread_mutex_unlock (&pool->lock);
+}
+
+/* Returns the calling thread's cache, or NULL if it couldn't be allocated
+   in which case the thread only uses the shared part of the pool. */
+static ThreadCache *PolylineEncoderPoolThreadCache (PolylineEncoderPool *pool)
+{
+  ThreadCache *cache = pthread_getspecific (pool->threadCacheKey);
+  if (cache)
+    return cache;
+
+  cache = calloc (1, sizeof (ThreadCache));
+  if (!cache)
+    return NULL;
+
+  cache->pool = pool;
+  pthread_mutex_lock (&pool->lock);
+  cache->next = pool->threadCaches;
+  if (cache->next)
+    cache->next->previous = cache;
+
+  pool->threadCaches = cache;
+  pthread_mutex_unlock (&pool->lock);
+
+  pthread_setspecific (pool->threadCacheKey, cache);
+  return cache;
+}
+
+PolylineEncoderPool *PolylineEncoderPoolCreate (unsigned maxPooledEncoders,
+                                                size_t maxRetainedBytes)
+{
+  PolylineEncoderPool *pool = calloc (1, sizeof (PolylineEncoderPool));
+  if (!pool)
+    return NULL;
+
+  pool->encoders = malloc ((maxPooledEncoders ? maxPooledEncoders : 1)
+                           * sizeof (PolylineEncoder *));
+  if (!pool->encoders
+      || pthread_key_create (&pool->threadCacheKey, ThreadCacheDestroy)) {
+    free (pool->encoders);
+    free (pool);
+    return NULL;
+  }
+
+  pthread_mutex_init (&pool->lock, NULL);
+  pool->maxRetainedBytes = maxRetainedBytes;
+  pool->maxPooledEncoders = maxPooledEncoders;
+  return pool;
+}
+
+void PolylineEncoderPoolFree (PolylineEncoderPool *pool)
+{
+  /* Deleting the key first stops ThreadCacheDestroy being called for
+     threads that exit later. */
+  pthread_key_delete (pool->threadCacheKey);
+
+  while (pool->threadCaches) {
+    ThreadCache *cache = pool->threadCaches;
+    for (unsigned i = 0; i < cache->encoderCount; ++i)
+      PolylineEncoderFree (cache->encoders[i]);
+
+    pool->threadCaches = cache->next;
+    free (cache);
+  }
+
+  for (unsigned i = 0; i < pool->encoderCount; ++i)
+    PolylineEncoderFree (pool->encoders[i]);
+
+  pthread_mutex_destroy (&pool->lock);
+  free (pool->encoders);
+  free (pool);
+}
+
+PolylineEncoder *PolylineEncoderPoolAcquire (PolylineEncoderPool *pool)
+{
+  ThreadCache *cache = PolylineEncoderPoolThreadCache (pool);
+  if (cache && cache->encoderCount) {
+    increment (&cache->hits);
+    return cache->encoders[--cache->encoderCount];
+  }
+
+  PolylineEncoder *encoder = NULL;
+  pthread_mutex_lock (&pool->lock);
+  if (pool->encoderCount)
+    encoder = pool->encoders[--pool->encoderCount];
+
+  /* Without a thread cache the stats go straight to the pool. */
+  if (!cache && encoder)
+    ++pool->retiredStats.hits;
+  else if (!cache)
+    ++pool->retiredStats.misses;
+
+  pthread_mutex_unlock (&pool->lock);
+
+  if (cache)
+    increment (encoder ? &cache->hits : &cache->misses);
+
+  return encoder ? encoder : PolylineEncoderCreate ();
+}
+
+void PolylineEncoderPoolRelease (PolylineEncoderPool *pool,
+                                 PolylineEncoder *encoder)
+{
+  PolylineEncoderReset (encoder, pool->maxRetainedBytes);
+
+  ThreadCache *cache = PolylineEncoderPoolThreadCache (pool);
+  if (cache && cache->encoderCount < THREAD_CACHE_SIZE) {
+    cache->encoders[cache->encoderCount++] = encoder;
+    return;
+  }
+
+  pthread_mutex_lock (&pool->lock);
+  bool added = PolylineEncoderPoolAddShared (pool, encoder);
+  if (!added && !cache)
+    ++pool->retiredStats.discards;
+
+  pthread_mutex_unlock (&pool->lock);
+
+  if (!added && cache)
+    increment (&cache->discards);
+}
+
+PolylineEncoderPoolStats PolylineEncoderPoolGetStats (PolylineEncoderPool *pool)
+{
+  pthread_mutex_lock (&pool->lock);
+  PolylineEncoderPoolStats stats = pool->retiredStats;
+  for (ThreadCache *cache = pool->threadCaches; cache; cache = cache->next) {
+    stats.hits += __atomic_load_n (&cache->hits, __ATOMIC_RELAXED);
+    stats.misses += __atomic_load_n (&cache->misses, __ATOMIC_RELAXED);
+    stats.discards += __atomic_load_n (&cache->discards, __ATOMIC_RELAXED);
+  }
+
+  pthread_mutex_unlock (&pool->lock);
+  return stats;
+}
@@ -0,0 +1,65 @@
+//
+//  polylineEncoderPool.h
+//  googlePolylineTest
+//
+//  A thread safe pool of PolylineEncoders for code that encodes many
+//  short polylines on many threads. Each thread keeps a few released
+//  encoders to itself so most acquires don't touch the shared pool, and
+//  released encoders keep their buffers, so once the pool is warm
+//  encoding doesn't call malloc.
+//
+
+#ifndef googlePolylineTest_polylineEncoderPool_h
+#define googlePolylineTest_polylineEncoderPool_h
+
+#include <stddef.h>
+
+#include "polylineFunctions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct PolylineEncoderPool;
+typedef struct PolylineEncoderPool PolylineEncoderPool;
+
+typedef struct PolylineEncoderPoolStats
+{
+  /* Acquires that were given a pooled encoder. */
+  size_t hits;
+  /* Acquires that had to create a new encoder. */
+  size_t misses;
+  /* Releases where the encoder was freed because the pool was full. */
+  size_t discards;
+} PolylineEncoderPoolStats;
+
+/* Creates an encoder pool.
+   maxPooledEncoders: The most released encoders the shared part of the
+                      pool holds, each thread also caches a few of its own.
+   maxRetainedBytes: The most buffer space a released encoder keeps, see
+                     PolylineEncoderReset.
+   Returns NULL if the pool couldn't be allocated. */
+PolylineEncoderPool *PolylineEncoderPoolCreate (unsigned maxPooledEncoders,
+                                                size_t maxRetainedBytes);
+
+/* Frees the pool and all of the encoders it holds. No thread may use the
+   pool during or after this call, encoders still acquired must be freed
+   with PolylineEncoderFree rather than released. */
+void PolylineEncoderPoolFree (PolylineEncoderPool *pool);
+
+/* Returns an encoder in the same state as a new one, or NULL if one
+   couldn't be allocated. */
+PolylineEncoder *PolylineEncoderPoolAcquire (PolylineEncoderPool *pool);
+
+/* Resets the encoder and returns it to the pool, don't use it afterwards. */
+void PolylineEncoderPoolRelease (PolylineEncoderPool *pool,
+                                 PolylineEncoder *encoder);
+
+/* The totals for all threads that have used the pool. */
+PolylineEncoderPoolStats PolylineEncoderPoolGetStats (PolylineEncoderPool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,378 @@
+//
+//  polylineFilter.c
+//  googlePolylineTest
+//
+
+/* Needed for pthreads when compiling with -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "polylineFilter.h"
+#include "polylineVarint.h"
+
+/* M_PI isn't part of C99. */
+#define POLYLINE_PI 3.14159265358979323846
+
+/* The length of 1e-5 degrees of latitude in metres, using the mean
+   radius of the earth. */
+static const double metresPerIntLat = 6371008.8 * POLYLINE_PI / 180.0 * 1e-5;
+
+typedef enum PolylineFilterType {
+  PolylineFilterTypeBounds,
+  PolylineFilterTypeCorridor
+} PolylineFilterType;
+
+struct PolylineFilter {
+  PolylineFilterType type;
+  /* The box in E5 integers, for a corridor this is the box around the
+     corridor expanded by its half width, anything outside it can be
+     rejected without measuring the distance to the corridor. */
+  int32_t minLat;
+  int32_t minLng;
+  int32_t maxLat;
+  int32_t maxLng;
+
+  /* Corridor points as (x, y) pairs, x is the longitude scaled by
+     lngScale so that both axes have about the same length per unit. */
+  int64_t *corridor;
+  size_t corridorCount;
+  /* cos (middle latitude) as a 16.16 fixed point value. */
+  int64_t lngScale;
+  double halfWidthSquared;
+};
+
+static inline int32_t intValue (double val)
+{
+  return (int32_t)round (val * 1e5);
+}
+
+PolylineFilter *PolylineFilterCreateWithBounds (double south, double west,
+                                                double north, double east)
+{
+  if (south > north || west > east)
+    return NULL;
+
+  PolylineFilter *filter = calloc (1, sizeof (PolylineFilter));
+  if (!filter)
+    return NULL;
+
+  filter->type = PolylineFilterTypeBounds;
+  filter->minLat = intValue (south);
+  filter->minLng = intValue (west);
+  filter->maxLat = intValue (north);
+  filter->maxLng = intValue (east);
+  return filter;
+}
+
+PolylineFilter *PolylineFilterCreateWithCorridor (const Coordinate *corridor,
+                                                  size_t corridorCount,
+                                                  double halfWidth)
+{
+  if (!corridorCount)
+    return NULL;
+
+  PolylineFilter *filter = calloc (1, sizeof (PolylineFilter));
+  if (!filter)
+    return NULL;
+
+  filter->type = PolylineFilterTypeCorridor;
+  filter->corridorCount = corridorCount;
+  filter->corridor = malloc (2 * corridorCount * sizeof (int64_t));
+  if (!filter->corridor) {
+    free (filter);
+    return NULL;
+  }
+
+  int32_t minLat = INT32_MAX, maxLat = INT32_MIN;
+  int32_t minLng = INT32_MAX, maxLng = INT32_MIN;
+  for (size_t i = 0; i < corridorCount; ++i) {
+    int32_t lat = intValue (corridor[i].latitude);
+    int32_t lng = intValue (corridor[i].longitude);
+    minLat = lat < minLat ? lat : minLat;
+    maxLat = lat > maxLat ? lat : maxLat;
+    minLng = lng < minLng ? lng : minLng;
+    maxLng = lng > maxLng ? lng : maxLng;
+  }
+
+  double middleLat = (minLat + (double)maxLat) * 0.5e-5;
+  filter->lngScale = (int64_t)round (cos (middleLat * POLYLINE_PI / 180.0) * 65536);
+  if (filter->lngScale < 1)
+    filter->lngScale = 1;
+
+  for (size_t i = 0; i < corridorCount; ++i) {
+    filter->corridor[2 * i] = intValue (corridor[i].longitude)
+                              * filter->lngScale >> 16;
+    filter->corridor[2 * i + 1] = intValue (corridor[i].latitude);
+  }
+
+  double intHalfWidth = halfWidth / metresPerIntLat;
+  filter->halfWidthSquared = intHalfWidth * intHalfWidth;
+
+  int64_t latMargin = (int64_t)ceil (intHalfWidth);
+  int64_t lngMargin = (int64_t)ceil (intHalfWidth * 65536 / filter->lngScale);
+  filter->minLat = (int32_t)(minLat - latMargin > INT32_MIN
+                             ? minLat - latMargin : INT32_MIN);
+  filter->maxLat = (int32_t)(maxLat + latMargin < INT32_MAX
+                             ? maxLat + latMargin : INT32_MAX);
+  filter->minLng = (int32_t)(minLng - lngMargin > INT32_MIN
+                             ? minLng - lngMargin : INT32_MIN);
+  filter->maxLng = (int32_t)(maxLng + lngMargin < INT32_MAX
+                             ? maxLng + lngMargin : INT32_MAX);
+  return filter;
+}
+
+void PolylineFilterFree (PolylineFilter *filter)
+{
+  if (filter->corridor)
+    free (filter->corridor);
+
+  free (filter);
+}
+
+/* Cohen-Sutherland style region code, 0 means the point is in the box. */
+static inline unsigned regionCode (const PolylineFilter *filter,
+                                   int32_t lat, int32_t lng)
+{
+  return (lat < filter->minLat)
+         | (lat > filter->maxLat) << 1
+         | (lng < filter->minLng) << 2
+         | (lng > filter->maxLng) << 3;
+}
+
+/* Which side of the line from (aLat, aLng) to (bLat, bLng) the point
+   (lat, lng) is on. */
+static inline int side (int64_t aLat, int64_t aLng, int64_t bLat, int64_t bLng,
+                        int64_t lat, int64_t lng)
+{
+  int64_t cross = (bLng - aLng) * (lat - aLat) - (bLat - aLat) * (lng - aLng);
+  return (cross > 0) - (cross < 0);
+}
+
+/* Called for a segment with both ends outside the box that isn't on the
+   outside of any single edge. The segment crosses the box unless all
+   of the corners are on the same side of it. */
+static bool segmentCrossesBounds (const PolylineFilter *filter,
+                                  int32_t aLat, int32_t aLng,
+                                  int32_t bLat, int32_t bLng)
+{
+  int sides = side (aLat, aLng, bLat, bLng, filter->minLat, filter->minLng)
+              + side (aLat, aLng, bLat, bLng, filter->minLat, filter->maxLng)
+              + side (aLat, aLng, bLat, bLng, filter->maxLat, filter->minLng)
+              + side (aLat, aLng, bLat, bLng, filter->maxLat, filter->maxLng);
+  return sides != 4 && sides != -4;
+}
+
+static bool boundsMatches (const PolylineFilter *filter,
+                           const char *encodedString)
+{
+  int32_t lat = 0, lng = 0;
+  if (!polylineReadCoordinate (&encodedString, NULL, &lat, &lng))
+    return false;
+
+  unsigned code = regionCode (filter, lat, lng);
+  if (!code)
+    return true;
+
+  int32_t previousLat = lat, previousLng = lng;
+  unsigned previousCode = code;
+  while (polylineReadCoordinate (&encodedString, NULL, &lat, &lng)) {
+    code = regionCode (filter, lat, lng);
+    if (!code)
+      return true;
+
+    if (!(code & previousCode)
+        && segmentCrossesBounds (filter, previousLat, previousLng, lat, lng))
+      return true;
+
+    previousLat = lat;
+    previousLng = lng;
+    previousCode = code;
+  }
+
+  return false;
+}
+
+/* The squared distance from the point p to the line segment from a to b,
+   all (x, y) pairs in corridor units. */
+static double pointSegmentDistanceSquared (const int64_t *p, const int64_t *a,
+                                          const int64_t *b)
+{
+  int64_t dx = b[0] - a[0], dy = b[1] - a[1];
+  int64_t wx = p[0] - a[0], wy = p[1] - a[1];
+  int64_t dot = dx * wx + dy * wy;
+  int64_t lengthSquared = dx * dx + dy * dy;
+
+  if (dot <= 0)
+    return (double)wx * wx + (double)wy * wy;
+
+  if (dot >= lengthSquared) {
+    double ex = p[0] - b[0], ey = p[1] - b[1];
+    return ex * ex + ey * ey;
+  }
+
+  double cross = (double)dx * wy - (double)dy * wx;
+  return cross * cross / lengthSquared;
+}
+
+/* Whether the polyline segment from p to q comes within the half width of
+   the corridor. Two segments that don't cross are closest at one of their
+   ends, so only the ends need measuring once crossings are ruled out. */
+static bool segmentInCorridor (const PolylineFilter *filter,
+                               const int64_t *p, const int64_t *q)
+{
+  const int64_t *corridor = filter->corridor;
+  /* A single corridor point is a segment from the point to itself. */
+  size_t segmentCount = filter->corridorCount > 1 ? filter->corridorCount - 1
+                                                  : 1;
+
+  for (size_t i = 0; i < segmentCount; ++i) {
+    const int64_t *a = corridor + 2 * i;
+    const int64_t *b = filter->corridorCount > 1 ? a + 2 : a;
+
+    /* Touching counts too, but then an end is on the other segment and
+       is found by the distances below. */
+    if (side (a[1], a[0], b[1], b[0], p[1], p[0])
+        * side (a[1], a[0], b[1], b[0], q[1], q[0]) < 0
+        && side (p[1], p[0], q[1], q[0], a[1], a[0])
+           * side (p[1], p[0], q[1], q[0], b[1], b[0]) < 0)
+      return true;
+
+    if (pointSegmentDistanceSquared (p, a, b) <= filter->halfWidthSquared
+        || pointSegmentDistanceSquared (q, a, b) <= filter->halfWidthSquared
+        || pointSegmentDistanceSquared (a, p, q) <= filter->halfWidthSquared
+        || pointSegmentDistanceSquared (b, p, q) <= filter->halfWidthSquared)
+      return true;
+  }
+
+  return false;
+}
+
+static bool corridorMatches (const PolylineFilter *filter,
+                             const char *encodedString)
+{
+  int32_t lat = 0, lng = 0;
+  if (!polylineReadCoordinate (&encodedString, NULL, &lat, &lng))
+    return false;
+
+  int64_t previous[2] = { lng * filter->lngScale >> 16, lat };
+  unsigned previousCode = regionCode (filter, lat, lng);
+  if (!previousCode && segmentInCorridor (filter, previous, previous))
+    return true;
+
+  while (polylineReadCoordinate (&encodedString, NULL, &lat, &lng)) {
+    int64_t point[2] = { lng * filter->lngScale >> 16, lat };
+    unsigned code = regionCode (filter, lat, lng);
+
+    /* Segments on the outside of one of the box's edges can't come
+       within the half width. */
+    if (!(code & previousCode) && segmentInCorridor (filter, previous, point))
+      return true;
+
+    previous[0] = point[0];
+    previous[1] = point[1];
+    previousCode = code;
+  }
+
+  return false;
+}
+
+bool PolylineFilterMatches (const PolylineFilter *filter,
+                            const char *encodedString)
+{
+  if (filter->type == PolylineFilterTypeBounds)
+    return boundsMatches (filter, encodedString);
+
+  return corridorMatches (filter, encodedString);
+}
+
+typedef struct FilterBatchRange {
+  const PolylineFilter *filter;
+  const char *const *encodedStrings;
+  size_t start;
+  size_t end;
+  /* Matches are written from matchingIndices[start], there can't be more
+     matches in the range than there are polylines. */
+  size_t *matchingIndices;
+  size_t matchCount;
+  bool onThread;
+} FilterBatchRange;
+
+static void *filterBatchRange (void *info)
+{
+  FilterBatchRange *range = info;
+  size_t *result = range->matchingIndices + range->start;
+  size_t count = 0;
+  for (size_t i = range->start; i < range->end; ++i) {
+    if (PolylineFilterMatches (range->filter, range->encodedStrings[i]))
+      result[count++] = i;
+  }
+
+  range->matchCount = count;
+  return NULL;
+}
+
+size_t PolylineFilterMatchBatch (const PolylineFilter *filter,
+                                 const char *const *encodedStrings,
+                                 size_t polylineCount,
+                                 unsigned threadCount,
+                                 size_t *matchingIndices)
+{
+  if (threadCount > polylineCount)
+    threadCount = (unsigned)polylineCount;
+
+  if (threadCount <= 1) {
+    FilterBatchRange range = { filter, encodedStrings, 0, polylineCount,
+                               matchingIndices, 0, false };
+    filterBatchRange (&range);
+    return range.matchCount;
+  }
+
+  FilterBatchRange *ranges = malloc (threadCount * sizeof (FilterBatchRange));
+  pthread_t *threads = malloc (threadCount * sizeof (pthread_t));
+  if (!ranges || !threads) {
+    /* Scan the whole batch on the calling thread instead. */
+    free (ranges);
+    free (threads);
+    return PolylineFilterMatchBatch (filter, encodedStrings, polylineCount, 1,
+                                     matchingIndices);
+  }
+
+  for (unsigned i = 0; i < threadCount; ++i) {
+    ranges[i] = (FilterBatchRange){ filter, encodedStrings,
+                                    polylineCount * i / threadCount,
+                                    polylineCount * (i + 1) / threadCount,
+                                    matchingIndices, 0, false };
+  }
+
+  /* The calling thread takes the first range itself. */
+  for (unsigned i = 1; i < threadCount; ++i) {
+    ranges[i].onThread = !pthread_create (&threads[i], NULL,
+                                          filterBatchRange, &ranges[i]);
+    if (!ranges[i].onThread)
+      filterBatchRange (&ranges[i]);
+  }
+
+  filterBatchRange (&ranges[0]);
+
+  /* Each range wrote its matches at the start of its own part of
+     matchingIndices, move them down so they're contiguous. */
+  size_t matchCount = ranges[0].matchCount;
+  for (unsigned i = 1; i < threadCount; ++i) {
+    if (ranges[i].onThread)
+      pthread_join (threads[i], NULL);
+
+    memmove (matchingIndices + matchCount,
+             matchingIndices + ranges[i].start,
+             ranges[i].matchCount * sizeof (size_t));
+    matchCount += ranges[i].matchCount;
+  }
+
+  free (threads);
+  free (ranges);
+  return matchCount;
+}
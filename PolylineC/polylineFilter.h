@@ -0,0 +1,70 @@
+//
+//  polylineFilter.h
+//  googlePolylineTest
+//
+//  Tests whether encoded polylines pass through an area without decoding
+//  them into Coordinates first.
+//
+
+#ifndef googlePolylineTest_polylineFilter_h
+#define googlePolylineTest_polylineFilter_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "polylineFunctions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct PolylineFilter;
+typedef struct PolylineFilter PolylineFilter;
+
+/* Creates a filter matching polylines that enter the box. The bounds are
+   rounded to the same 1e-5 precision the polylines are encoded with, and
+   the box must not cross the antimeridian (west <= east). A polyline
+   matches if any of its points are inside the box, or if any of its line
+   segments cross the box. Returns NULL if south > north or west > east,
+   or if the memory couldn't be allocated. */
+PolylineFilter *PolylineFilterCreateWithBounds (double south, double west,
+                                                double north, double east);
+
+/* Creates a filter matching polylines that come within halfWidth metres of
+   the line through corridor, either at one of their points or along one of
+   their line segments. Distances use an equirectangular approximation
+   around the corridor's middle latitude, so this is meant for corridors
+   up to a few hundred kilometres long. The corridor coordinates are
+   copied. Returns NULL if corridorCount is 0
+   or the memory couldn't be allocated. */
+PolylineFilter *PolylineFilterCreateWithCorridor (const Coordinate *corridor,
+                                                  size_t corridorCount,
+                                                  double halfWidth);
+
+void PolylineFilterFree (PolylineFilter *filter);
+
+/* Returns true if the encoded polyline matches the filter. The string is
+   scanned keeping the running integer latitude and longitude, it returns
+   as soon as a point or segment matches. An incomplete final coordinate
+   is ignored. */
+bool PolylineFilterMatches (const PolylineFilter *filter,
+                            const char *encodedString);
+
+/* Runs PolylineFilterMatches over a batch of NUL terminated polylines.
+   matchingIndices: Must have room for polylineCount indices. The indices
+                    of the matching polylines are written to it in
+                    ascending order.
+   threadCount: The number of threads to split the batch across, 0 or 1
+                scans the batch on the calling thread.
+   return: The number of matching polylines. */
+size_t PolylineFilterMatchBatch (const PolylineFilter *filter,
+                                 const char *const *encodedStrings,
+                                 size_t polylineCount,
+                                 unsigned threadCount,
+                                 size_t *matchingIndices);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
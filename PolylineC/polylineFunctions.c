@@ -15,10 +15,57 @@
 
 #include "polylineFunctions.h"
 #include "AppendableDataStore.h"
+#include "polylineVarint.h"
 
 static unsigned charsPerNode = 1024;
 static unsigned coordsPerNode = 1024;
 
+/* Build with -DPOLYLINE_ENCODE_TABLE=0 to encode every value with the loop
+   in encodeIntValue, `make bench` compares the two. */
+#ifndef POLYLINE_ENCODE_TABLE
+#define POLYLINE_ENCODE_TABLE 1
+#endif
+
+#if POLYLINE_ENCODE_TABLE
+/* The characters for every zig-zagged value below 1024, which is any
+   difference of up to 512 (0.00512 degrees) either way and covers most of
+   a dense GPS trace. Values below 32 only use the first character, the
+   rest use both. The table is 2KB so it stays in the L1 cache. */
+#define ENCODE_TABLE_SIZE 1024
+#define ENCODE_ENTRY(v) { (char)((((v) & 0x1f) | ((v) >= 32 ? 0x20 : 0)) + 63), \
+                          (char)(((v) >> 5) + 63) }
+#define ENCODE_ENTRIES_4(v) ENCODE_ENTRY (v), ENCODE_ENTRY ((v) + 1), \
+                            ENCODE_ENTRY ((v) + 2), ENCODE_ENTRY ((v) + 3)
+#define ENCODE_ENTRIES_16(v) ENCODE_ENTRIES_4 (v), ENCODE_ENTRIES_4 ((v) + 4), \
+                             ENCODE_ENTRIES_4 ((v) + 8), ENCODE_ENTRIES_4 ((v) + 12)
+#define ENCODE_ENTRIES_64(v) ENCODE_ENTRIES_16 (v), ENCODE_ENTRIES_16 ((v) + 16), \
+                             ENCODE_ENTRIES_16 ((v) + 32), ENCODE_ENTRIES_16 ((v) + 48)
+#define ENCODE_ENTRIES_256(v) ENCODE_ENTRIES_64 (v), ENCODE_ENTRIES_64 ((v) + 64), \
+                              ENCODE_ENTRIES_64 ((v) + 128), ENCODE_ENTRIES_64 ((v) + 192)
+
+static const char encodeTable[ENCODE_TABLE_SIZE][2] = {
+  ENCODE_ENTRIES_256 (0), ENCODE_ENTRIES_256 (256),
+  ENCODE_ENTRIES_256 (512), ENCODE_ENTRIES_256 (768)
+};
+#endif
+
+static inline bool isPolylineChar (char c)
+{
+  return c >= 63 && c <= 126;
+}
+
+/* Whether any of the first length characters of string, stopping at a
+   NUL, can't be part of a polyline. */
+static bool hasBadChar (const char *string, size_t length)
+{
+  for (size_t i = 0; i < length && string[i]; ++i) {
+    if (!isPolylineChar (string[i]))
+      return true;
+  }
+
+  return false;
+}
+
 struct PolylineEncoder {
   int32_t intLat;
   int32_t intLng;
@@ -27,15 +74,17 @@ struct PolylineEncoder {
   char *unusedChars;
 };
 
-PolylineEncoder *PolylineEncoderCreate () {
-  PolylineEncoder *result = calloc (1, sizeof (PolylineEncoder));
-  result->dataStore = NULL;
-  return result;
+unsigned PolylineLibraryVersion (void) {
+  return POLYLINE_VERSION;
+}
+
+PolylineEncoder *PolylineEncoderCreate (void) {
+  return calloc (1, sizeof (PolylineEncoder));
 }
 
 void PolylineEncoderFree (PolylineEncoder *encoder) {
   if (encoder->dataStore)
-    free (encoder->dataStore);
+    AppendableDataStoreFree (encoder->dataStore);
 
   if (encoder->unusedChars)
     free (encoder->unusedChars);
@@ -43,19 +92,58 @@ void PolylineEncoderFree (PolylineEncoder *encoder) {
   free (encoder);
 }
 
+size_t PolylineEncoderRetainedBytes (PolylineEncoder *encoder) {
+  if (!encoder->dataStore)
+    return 0;
+
+  return AppendableDataStoreCapacity (encoder->dataStore);
+}
+
+void PolylineEncoderReset (PolylineEncoder *encoder, size_t maxRetainedBytes) {
+  encoder->intLat = 0;
+  encoder->intLng = 0;
+
+  if (encoder->unusedChars) {
+    free (encoder->unusedChars);
+    encoder->unusedChars = NULL;
+  }
+
+  if (!encoder->dataStore)
+    return;
+
+  size_t nodeSize = AppendableDataStoreDataTypeSize (encoder->dataStore)
+                    * (AppendableDataStoreDataTypeSize (encoder->dataStore) == 1
+                       ? charsPerNode : coordsPerNode);
+  /* Rounded up so that a limit smaller than a node still keeps one. */
+  size_t maxRetainedNodes = maxRetainedBytes / nodeSize
+                            + (maxRetainedBytes % nodeSize != 0);
+  if (!maxRetainedNodes) {
+    AppendableDataStoreFree (encoder->dataStore);
+    encoder->dataStore = NULL;
+    return;
+  }
+
+  AppendableDataStoreReset (encoder->dataStore, (unsigned)maxRetainedNodes);
+}
+
 /* Value: The latitude or longitude to encode.
    previousIntVal: For the first call this should point at 0. It is updated
                    in the function to the value that it needs to be for
                    subsequent calls. This value must be unique to each set of
                    values you're encoding (i.e. you can't point at the same
                    thing for latitude and longitude).
-   result: A buffer with at least 5 chars of space available (as this is the
+   result: A buffer with at least 6 chars of space available (as this is the
            maximum number of characters that can be added).
    charCount: Incremented by the number of characters added to result.
 */
 static void encodeValue (double val, int32_t *previousIntVal,
                          char *result, unsigned *charCount);
 
+/* The same as encodeValue, but for a value that has already been
+   converted to its integer (E5) representation. */
+static void encodeIntValue (int32_t intVal, int32_t *previousIntVal,
+                            char *result, unsigned *charCount);
+
 /* string: The string to get the next difference value from, if there aren't
            enough characters to get a valid value the function will return 
            false.
@@ -72,105 +160,213 @@ static void encodeValue (double val, int32_t *previousIntVal,
            We may fail to decode a value if we are streaming and we don't 
            have all the charaters needed.
 */
-static bool decodenValue (char *string, unsigned *usedChars,
+static bool decodenValue (const char *string, unsigned *usedChars,
                          int32_t *previousIntValue, double *result,
                          size_t n);
 
 /* Decodes a single Coordinate from the encodedString. */
-bool PolylineEncoderDecodeNextCoord (PolylineEncoder *encoder,
-                                     char *encodedString,
-                                     size_t n,
-                                     Coordinate *returnVal,
-                                     unsigned *usedCharsCount);
+static bool PolylineEncoderDecodeNextCoord (PolylineEncoder *encoder,
+                                            const char *encodedString,
+                                            size_t n,
+                                            Coordinate *returnVal,
+                                            unsigned *usedCharsCount);
+
+/* Only coordinates in range are encoded, which keeps each one within
+   POLYLINE_MAX_COORDINATE_CHARS and its E5 values within an int32_t. NaN
+   fails both comparisons. */
+static inline bool coordinateInRange (double latitude, double longitude)
+{
+  return fabs (latitude) <= 90 && fabs (longitude) <= 180;
+}
+
+/* The same range for a fixed point coordinate. */
+static inline bool fixedPointInRange (int32_t latitude, int32_t longitude,
+                                      int32_t unitsPerDegree)
+{
+  return llabs (latitude) <= 90 * (int64_t)unitsPerDegree
+         && llabs (longitude) <= 180 * (int64_t)unitsPerDegree;
+}
 
 unsigned PolylineEncoderGetEncodedCoordinate (PolylineEncoder *encoder,
                                               Coordinate coord,
                                               char *result) {
-  if (!result) {
-    printf ("result variable was not set. Line %d, file %s",
-            __LINE__, __FILE__);
-    exit (1);
-  }
+  if (!result || !coordinateInRange (coord.latitude, coord.longitude))
+    return 0;
   
   unsigned usedChars = 0;
   encodeValue (coord.latitude, &encoder->intLat, result, &usedChars);
   encodeValue (coord.longitude, &encoder->intLng, result + usedChars, &usedChars);
-  
-#if DEBUG
-  if (usedChars > 10) {
-    printf ("Problem encoding coordinate it should never take "
-            "more than 10 chars to encode two coordinates. There is a "
-            "programmer error!"
-            "line %d in file %s", __LINE__, __FILE__);
-    exit (1);
-  }
-#endif
-  
   return usedChars;
 }
 
-static inline void PolylineEncoderEncodeCoordinateInternal (PolylineEncoder *encoder,
-                                              Coordinate coord) {
-  char result[10];
+static inline PolylineStatus PolylineEncoderEncodeCoordinateInternal (PolylineEncoder *encoder,
+                                                                     Coordinate coord) {
+  char result[POLYLINE_MAX_COORDINATE_CHARS];
   unsigned usedChars = PolylineEncoderGetEncodedCoordinate (encoder,
                                                             coord,
                                                             result);
-  
-  if (!encoder->dataStore)
+  if (!usedChars)
+    return PolylineStatusInvalidArgument;
+
+  if (!encoder->dataStore
+      || AppendableDataStoreDataTypeSize (encoder->dataStore) != sizeof (char)) {
+    /* A reset encoder may still have the store it used for decoding. */
+    if (encoder->dataStore)
+      AppendableDataStoreFree (encoder->dataStore);
+
     encoder->dataStore = AppendableDataStoreCreate (charsPerNode, sizeof (char));
+    if (!encoder->dataStore)
+      return PolylineStatusOutOfMemory;
+  }
 
   AppendableDataStoreAddData (encoder->dataStore, result, usedChars);
+  return PolylineStatusSuccess;
 }
 
-void PolylineEncoderEncodeCoordinate (PolylineEncoder *encoder, Coordinate coord) {
-  PolylineEncoderEncodeCoordinateInternal (encoder, coord);
+PolylineStatus PolylineEncoderEncodeCoordinate (PolylineEncoder *encoder,
+                                                Coordinate coord) {
+  return PolylineEncoderEncodeCoordinateInternal (encoder, coord);
 }
 
-void PolylineEncoderEncodeCoordintates (PolylineEncoder *encoder,
-                                        Coordinate *coords,
-                                        unsigned coordCount) {
-  for (unsigned i = 0; i < coordCount; ++i) {
-    PolylineEncoderEncodeCoordinateInternal (encoder, coords[i]);
+PolylineStatus PolylineEncoderEncodeCoordintates (PolylineEncoder *encoder,
+                                                  const Coordinate *coords,
+                                                  size_t coordCount) {
+  for (size_t i = 0; i < coordCount; ++i) {
+    PolylineStatus status = PolylineEncoderEncodeCoordinateInternal (encoder,
+                                                                     coords[i]);
+    if (status != PolylineStatusSuccess)
+      return status;
   }
+
+  return PolylineStatusSuccess;
 }
 
-char *copyEncodedLocationsString (Coordinate *coords, unsigned coordsCount)
+char *copyEncodedLocationsString (const Coordinate *coords, size_t coordsCount)
 {
+  /* Allocating for the worst case keeps any checks out of the loop, the
+     unused space is given back at the end. */
+  char *result = malloc (coordsCount * POLYLINE_MAX_COORDINATE_CHARS + 1);
+  if (!result)
+    return NULL;
+
   unsigned resultCount = 0;
-  /* Take a guess that it takes about 3 characters to encode each double
-     there are two doubles per coord. Then add a bit in the hope that we 
-     don't need to realloc. */
-  unsigned resultLength = 6 * coordsCount + 20;
-  char *result = malloc (resultLength);
+  int32_t intLat = 0, intLng = 0;
 
-  PolylineEncoder *encoder = PolylineEncoderCreate ();
-  
-  for (int i = 0; i < coordsCount; ++i) {
-    resultCount += PolylineEncoderGetEncodedCoordinate (encoder,
-                                                        coords[i],
-                                                        result + resultCount);
-    if (resultLength - resultCount < 11) {
-      /* In this case we may overrun our results buffer, so we need to allocate
-         more memory. We know how many characters on average it has taken to encode
-         a coordinate assuming this continues we can work out approximately how 
-         many more charaters we need. */
-      float charsPerCoord = (float)resultCount / i;
-      /* Add a bit extra for luck (this reduces the chance that we'll have to 
-         reallocate memory again. */
-      resultLength = charsPerCoord * coordsCount + 20;
-      result = realloc (result, resultLength);
+  for (size_t i = 0; i < coordsCount; ++i) {
+    if (!coordinateInRange (coords[i].latitude, coords[i].longitude)) {
+      free (result);
+      return NULL;
     }
+
+    encodeValue (coords[i].latitude, &intLat, result + resultCount, &resultCount);
+    encodeValue (coords[i].longitude, &intLng, result + resultCount, &resultCount);
   }
   
   result[resultCount] = '\0';
-  result = realloc(result, resultCount + 1);
-  
-  return result;
+  return realloc (result, resultCount + 1);
+}
+
+/* Converts a fixed point value to its integer (E5) representation,
+   rounding halves away from zero like round () does. */
+static inline int32_t fixedPointToIntValue (int32_t value, int32_t unitsPerDegree)
+{
+  int64_t scaled = (int64_t)value * 100000;
+  int64_t magnitude = scaled < 0 ? -scaled : scaled;
+  int64_t rounded = (2 * magnitude + unitsPerDegree) / (2 * (int64_t)unitsPerDegree);
+  return (int32_t)(scaled < 0 ? -rounded : rounded);
+}
+
+unsigned PolylineEncoderGetEncodedFixedPointCoordinate (PolylineEncoder *encoder,
+                                                        int32_t latitude,
+                                                        int32_t longitude,
+                                                        int32_t unitsPerDegree,
+                                                        char *result)
+{
+  if (!result || unitsPerDegree <= 0
+      || !fixedPointInRange (latitude, longitude, unitsPerDegree))
+    return 0;
+
+  unsigned usedChars = 0;
+  encodeIntValue (fixedPointToIntValue (latitude, unitsPerDegree),
+                  &encoder->intLat, result, &usedChars);
+  encodeIntValue (fixedPointToIntValue (longitude, unitsPerDegree),
+                  &encoder->intLng, result + usedChars, &usedChars);
+  return usedChars;
+}
+
+char *copyEncodedFixedPointLocationsString (const int32_t *latLngs,
+                                            size_t coordsCount,
+                                            int32_t unitsPerDegree)
+{
+  if (unitsPerDegree <= 0)
+    return NULL;
+
+  /* Allocating for the worst case keeps any checks out of the loop. */
+  char *result = malloc (coordsCount * POLYLINE_MAX_COORDINATE_CHARS + 1);
+  if (!result)
+    return NULL;
+
+  for (size_t i = 0; i < coordsCount; ++i) {
+    if (!fixedPointInRange (latLngs[2 * i], latLngs[2 * i + 1],
+                            unitsPerDegree)) {
+      free (result);
+      return NULL;
+    }
+  }
+
+  unsigned resultCount = 0;
+  int32_t intLat = 0, intLng = 0;
+
+  if (unitsPerDegree == 100000) {
+    /* The values are already in the polyline's precision. */
+    for (size_t i = 0; i < coordsCount; ++i) {
+      encodeIntValue (latLngs[2 * i], &intLat, result + resultCount, &resultCount);
+      encodeIntValue (latLngs[2 * i + 1], &intLng, result + resultCount, &resultCount);
+    }
+  } else {
+    for (size_t i = 0; i < coordsCount; ++i) {
+      encodeIntValue (fixedPointToIntValue (latLngs[2 * i], unitsPerDegree),
+                      &intLat, result + resultCount, &resultCount);
+      encodeIntValue (fixedPointToIntValue (latLngs[2 * i + 1], unitsPerDegree),
+                      &intLng, result + resultCount, &resultCount);
+    }
+  }
+
+  result[resultCount] = '\0';
+  return realloc (result, resultCount + 1);
+}
+
+char *copyEncodedFloatLocationsString (const float *latLngs,
+                                       size_t coordsCount)
+{
+  char *result = malloc (coordsCount * POLYLINE_MAX_COORDINATE_CHARS + 1);
+  if (!result)
+    return NULL;
+
+  unsigned resultCount = 0;
+  int32_t intLat = 0, intLng = 0;
+
+  for (size_t i = 0; i < coordsCount; ++i) {
+    if (!coordinateInRange (latLngs[2 * i], latLngs[2 * i + 1])) {
+      free (result);
+      return NULL;
+    }
+
+    encodeValue (latLngs[2 * i], &intLat, result + resultCount, &resultCount);
+    encodeValue (latLngs[2 * i + 1], &intLng, result + resultCount, &resultCount);
+  }
+
+  result[resultCount] = '\0';
+  return realloc (result, resultCount + 1);
 }
 
 static inline void PolylineEncoderAppendCoordinate (PolylineEncoder *encoder,
                                                     Coordinate coord) {
-  if (!encoder->dataStore) {
+  if (!encoder->dataStore
+      || AppendableDataStoreDataTypeSize (encoder->dataStore) != sizeof (Coordinate)) {
+    if (encoder->dataStore)
+      AppendableDataStoreFree (encoder->dataStore);
+
     encoder->dataStore = AppendableDataStoreCreate (coordsPerNode,
                                                     sizeof (Coordinate)); 
   }
@@ -180,40 +376,41 @@ static inline void PolylineEncoderAppendCoordinate (PolylineEncoder *encoder,
 
 /* Part of the PolylineEncoderDecodeCoordinates function, this function
    decodes any unused chars from the previous decoding using some of
-   the new characters. If there aren't enough new characters it returns
-   -1. Otherwise it returns the number of new characters used. */
+   the new characters. Returns the number of new characters used, 0 if
+   there still aren't enough characters to decode a coordinate (they're
+   kept for next time), or -1 if the characters can't be a coordinate. */
 static inline int PolylineEncoderDecodeUnusedChars (PolylineEncoder *encoder,
-                                                    char *encodedString)
+                                                    const char *encodedString)
 {
-  if (!encoder->unusedChars)
-    return -1;
-  
   size_t unusedLen = strlen (encoder->unusedChars);
   unsigned minStringLength = 0;
   unsigned usedChars;
   Coordinate coord;
-  for (; minStringLength < 10 - unusedLen; ++minStringLength) {
+  for (; minStringLength < POLYLINE_MAX_COORDINATE_CHARS - unusedLen;
+       ++minStringLength) {
     if (encodedString[minStringLength] == '\0')
       break;
   }
 
-  if (!minStringLength) {
-    /* There were no new characters in encodedString. */
-    encoder->unusedChars = NULL;
-    return -1;
-  }
-
-  /* The largest the resulting string can be is 10 chars. */
+  /* The largest the resulting string can be is
+     POLYLINE_MAX_COORDINATE_CHARS chars. */
   strncat (encoder->unusedChars, encodedString, minStringLength);
 
-  /* If there are less than 10 charaters in the string now it's possible
-     that we still won't be able to decode the next value. */
+  /* If there are less than POLYLINE_MAX_COORDINATE_CHARS charaters in the
+     string now it's possible that we still won't be able to decode the
+     next value. */
   bool gotNextCoord = PolylineEncoderDecodeNextCoord (encoder, encoder->unusedChars,
-                                                      10, &coord, &usedChars);
-  /* It's possoble that we still don't have enough charaters to decode
-     a value. */
-  if (!gotNextCoord)
-    return -1;
+                                                      POLYLINE_MAX_COORDINATE_CHARS,
+                                                      &coord, &usedChars);
+  if (!gotNextCoord) {
+    /* Every coordinate fits in POLYLINE_MAX_COORDINATE_CHARS, if that
+       many characters aren't enough they aren't a coordinate. */
+    if (unusedLen + minStringLength == POLYLINE_MAX_COORDINATE_CHARS
+        || hasBadChar (encoder->unusedChars, POLYLINE_MAX_COORDINATE_CHARS))
+      return -1;
+
+    return 0;
+  }
 
   PolylineEncoderAppendCoordinate (encoder, coord);
   free (encoder->unusedChars);
@@ -221,29 +418,33 @@ static inline int PolylineEncoderDecodeUnusedChars (PolylineEncoder *encoder,
   return usedChars - (unsigned)unusedLen;
 }
 
-void PolylineEncoderDecodeCoordinates (PolylineEncoder *encoder,
-                                       char *encodedString,
-                                       unsigned *decodedCoordCount) {
+PolylineStatus PolylineEncoderDecodeCoordinates (PolylineEncoder *encoder,
+                                                 const char *encodedString,
+                                                 size_t *decodedCoordCount) {
   Coordinate coord;
   unsigned usedChars = 0;
 
   *decodedCoordCount = 0;
 
   if (encoder->unusedChars) {
-    usedChars = PolylineEncoderDecodeUnusedChars (encoder,
-                                                  encodedString);
-    if (usedChars <= 0) {
-      *decodedCoordCount = 0;
-      return;
-    } else {
-      *decodedCoordCount += 1;
+    int newChars = PolylineEncoderDecodeUnusedChars (encoder, encodedString);
+    if (newChars < 0) {
+      /* Don't keep characters that can never be decoded. */
+      free (encoder->unusedChars);
+      encoder->unusedChars = NULL;
+      return PolylineStatusMalformedInput;
     }
 
-    encodedString += usedChars;
+    if (!newChars)
+      return PolylineStatusSuccess;
+
+    *decodedCoordCount += 1;
+    encodedString += newChars;
   }
 
   while (PolylineEncoderDecodeNextCoord (encoder, encodedString,
-                                         10, &coord, &usedChars)) {
+                                         POLYLINE_MAX_COORDINATE_CHARS,
+                                         &coord, &usedChars)) {
     encodedString += usedChars;
     PolylineEncoderAppendCoordinate (encoder, coord);
     *decodedCoordCount += 1;
@@ -251,77 +452,317 @@ void PolylineEncoderDecodeCoordinates (PolylineEncoder *encoder,
 
   size_t remainingLen = strlen (encodedString);
   if (!remainingLen)
-    return;
+    return PolylineStatusSuccess;
 
-  if (remainingLen > 10) {
-    printf ("We exited decode a polyline for an unknow reason. "
-            "line %d, file %s", __LINE__, __FILE__);
-    exit (1);
-  }
+  /* Decoding only stops early at the end of the string or at a character
+     outside '?' to '~', anything longer than a coordinate that couldn't be
+     decoded is bad input. */
+  if (remainingLen > POLYLINE_MAX_COORDINATE_CHARS
+      || hasBadChar (encodedString, remainingLen))
+    return PolylineStatusMalformedInput;
+
+  encoder->unusedChars = malloc ((POLYLINE_MAX_COORDINATE_CHARS + 1)
+                                 * sizeof (char));
+  if (!encoder->unusedChars)
+    return PolylineStatusOutOfMemory;
 
-  encoder->unusedChars = malloc (11 * sizeof (char));
   strcpy (encoder->unusedChars, encodedString);
+  return PolylineStatusSuccess;
 }
 
 Coordinate *PolylineEncoderGetDecodedCoordinates (PolylineEncoder *encoder,
-                                                  char *encodedString,
-                                                  unsigned *decodedCount)
+                                                  const char *encodedString,
+                                                  size_t *decodedCount,
+                                                  PolylineStatus *status)
 {
-  if (encodedString[0] == '\0') {
-    *decodedCount = 0;
-    return NULL;
-  }
-  
-  PolylineEncoderDecodeCoordinates (encoder,
-                                    encodedString,
-                                    decodedCount);
-  if (!decodedCount)
+  PolylineStatus result = PolylineStatusSuccess;
+  *decodedCount = 0;
+  if (encodedString[0] != '\0')
+    result = PolylineEncoderDecodeCoordinates (encoder, encodedString,
+                                               decodedCount);
+  if (status)
+    *status = result;
+
+  if (!*decodedCount)
     return NULL;
   
-  Coordinate *result = AppendableDataStoreGetData (encoder->dataStore);
+  Coordinate *coords = AppendableDataStoreGetData (encoder->dataStore);
   AppendableDataStoreFree (encoder->dataStore);
   encoder->dataStore = NULL;
-  return result;
+  return coords;
 }
 
-Coordinate *decodeLocationsString (char *polylineString, unsigned *locsCount)
+Coordinate *decodeLocationsString (const char *polylineString,
+                                   size_t *locsCount)
 {
+  *locsCount = 0;
   PolylineEncoder *encoder = PolylineEncoderCreate ();
-  PolylineEncoderDecodeCoordinates (encoder,
-                                    polylineString,
-                                    locsCount);
-  return AppendableDataStoreGetData (encoder->dataStore);
+  if (!encoder)
+    return NULL;
+
+  PolylineStatus status = PolylineEncoderDecodeCoordinates (encoder,
+                                                            polylineString,
+                                                            locsCount);
+  Coordinate *result = NULL;
+  if (status != PolylineStatusSuccess)
+    *locsCount = 0;
+  else if (encoder->dataStore)
+    result = AppendableDataStoreGetData (encoder->dataStore);
+
+  PolylineEncoderFree (encoder);
+  return result;
+}
+
+/* Each difference is at most 6 characters, see
+   POLYLINE_MAX_COORDINATE_CHARS. */
+#define MAX_VALUE_CHARS (POLYLINE_MAX_COORDINATE_CHARS / 2)
+
+typedef enum CheckedValue {
+  CheckedValueComplete,
+  CheckedValueIncomplete,
+  CheckedValueDamaged
+} CheckedValue;
+
+static inline bool isLastValueChar (char c)
+{
+  return isPolylineChar (c) && !((c - 63) & 0x20);
+}
+
+/* Reads the difference at *position, like polylineReadValue, but checks
+   every character. On CheckedValueDamaged errorOffset is set to the first
+   character that can't be part of the value, one outside '?' to '~' or
+   one more than MAX_VALUE_CHARS. */
+static CheckedValue readCheckedValue (const char *string, size_t length,
+                                      size_t *position, int32_t *difference,
+                                      size_t *errorOffset)
+{
+  uint32_t bits = 0;
+  size_t i = *position;
+  for (unsigned count = 0; ; ++count) {
+    if (i == length)
+      return CheckedValueIncomplete;
+
+    if (!isPolylineChar (string[i]) || count == MAX_VALUE_CHARS) {
+      *errorOffset = i;
+      return CheckedValueDamaged;
+    }
+
+    int currentByte = string[i++] - 63;
+    bits |= (uint32_t)(currentByte & 0x1f) << (5 * count);
+    if (!(currentByte & 0x20))
+      break;
+  }
+
+  *difference = (int32_t)(bits >> 1);
+  if (bits & 1)
+    *difference = ~*difference;
+
+  *position = i;
+  return CheckedValueComplete;
+}
+
+Coordinate *decodeDamagedLocationsString (const char *polylineString,
+                                          size_t length,
+                                          bool resync,
+                                          size_t *locsCount,
+                                          PolylineDamageReport *report)
+{
+  PolylineDamageReport ignoredReport;
+  if (!report)
+    report = &ignoredReport;
+
+  *locsCount = 0;
+  *report = (PolylineDamageReport){ length, 0, 0, 0, false };
+
+  /* Every value takes at least a character, damaged ones included. */
+  Coordinate *coords = malloc ((length / 2 + 1) * sizeof (Coordinate));
+  if (!coords)
+    return NULL;
+
+  size_t count = 0;
+  size_t position = 0;
+  /* Where the coordinate being read starts. */
+  size_t coordStart = 0;
+  uint32_t intValues[2] = { 0, 0 };
+  int32_t differences[2] = { 0, 0 };
+  unsigned valueIndex = 0;
+  bool reachedEnd = false;
+
+  for (;;) {
+    size_t errorOffset;
+    CheckedValue result = readCheckedValue (polylineString, length, &position,
+                                            &differences[valueIndex],
+                                            &errorOffset);
+    if (result == CheckedValueIncomplete) {
+      reachedEnd = true;
+      break;
+    }
+
+    if (result == CheckedValueDamaged) {
+      if (!report->damagedValueCount) {
+        report->errorOffset = errorOffset;
+        report->validLength = coordStart;
+        report->validCount = count;
+      }
+
+      ++report->damagedValueCount;
+      if (!resync)
+        break;
+
+      /* The rest of the damaged value runs up to the next character that
+         ends a value, the value after it is taken to be the next one.
+         The damaged value's difference is lost, so it's taken to be 0. */
+      position = errorOffset;
+      while (position < length && !isLastValueChar (polylineString[position]))
+        ++position;
+
+      if (position == length) {
+        reachedEnd = true;
+        break;
+      }
+
+      ++position;
+      differences[valueIndex] = 0;
+    }
+
+    if (valueIndex) {
+      intValues[0] += (uint32_t)differences[0];
+      intValues[1] += (uint32_t)differences[1];
+      coords[count].latitude = (int32_t)intValues[0] * 1e-5;
+      coords[count].longitude = (int32_t)intValues[1] * 1e-5;
+      ++count;
+      coordStart = position;
+    }
+
+    valueIndex ^= 1;
+  }
+
+  if (!report->damagedValueCount) {
+    report->validLength = coordStart;
+    report->validCount = count;
+  }
+
+  report->truncated = reachedEnd && coordStart < length;
+  *locsCount = count;
+  if (!count) {
+    free (coords);
+    return NULL;
+  }
+
+  Coordinate *result = realloc (coords, count * sizeof (Coordinate));
+  return result ? result : coords;
+}
+
+void PolylineCursorInit (PolylineCursor *cursor, const char *encodedString,
+                         size_t length)
+{
+  cursor->position = encodedString;
+  cursor->end = encodedString + length;
+  cursor->intLat = 0;
+  cursor->intLng = 0;
+}
+
+bool PolylineCursorNext (PolylineCursor *cursor, Coordinate *coord)
+{
+  if (!polylineReadCoordinate (&cursor->position, cursor->end,
+                               &cursor->intLat, &cursor->intLng))
+    return false;
+
+  coord->latitude = cursor->intLat * 1e-5;
+  coord->longitude = cursor->intLng * 1e-5;
+  return true;
+}
+
+size_t PolylineCursorNextN (PolylineCursor *cursor, Coordinate *coords,
+                            size_t n)
+{
+  size_t count = 0;
+  while (count < n && PolylineCursorNext (cursor, coords + count))
+    ++count;
+
+  return count;
+}
+
+size_t PolylineCursorSkip (PolylineCursor *cursor, size_t n)
+{
+  size_t count = 0;
+  while (count < n && polylineReadCoordinate (&cursor->position, cursor->end,
+                                              &cursor->intLat,
+                                              &cursor->intLng))
+    ++count;
+
+  return count;
+}
+
+size_t PolylineCursorRemainingBytes (const PolylineCursor *cursor)
+{
+  return cursor->end - cursor->position;
+}
+
+POLYLINE_VECTOR_KERNEL
+size_t polylineCountValues (const char *string, size_t length)
+{
+  /* Every value ends with a character that doesn't have the 0x20
+     continuation bit set. */
+  size_t count = 0;
+  for (size_t i = 0; i < length; ++i)
+    count += !((string[i] - 63) & 0x20);
+
+  return count;
+}
+
+POLYLINE_VECTOR_KERNEL
+size_t polylineCountBadChars (const char *string, size_t length)
+{
+  size_t count = 0;
+  for (size_t i = 0; i < length; ++i)
+    count += (unsigned char)(string[i] - 63) > 126 - 63;
+
+  return count;
 }
 
 char *PolylineEncoderCopyEncodedString (PolylineEncoder *encoder) {
-  size_t size = AppendableDataStoreDataSize (encoder->dataStore);
-  char *result = malloc (size + 1);
-  AppendableDataStoreCollapseDataIntoResult (encoder->dataStore, result);
-  result[size] = '\0';
+  char *result = malloc (PolylineEncoderEncodedStringLength (encoder) + 1);
+  PolylineEncoderGetEncodedString (encoder, result);
   return result;
 }
 
+size_t PolylineEncoderEncodedStringLength (PolylineEncoder *encoder) {
+  if (!encoder->dataStore)
+    return 0;
+
+  return AppendableDataStoreDataSize (encoder->dataStore);
+}
+
+void PolylineEncoderGetEncodedString (PolylineEncoder *encoder, char *result) {
+  size_t size = PolylineEncoderEncodedStringLength (encoder);
+  if (size)
+    AppendableDataStoreCollapseDataIntoResult (encoder->dataStore, result);
+
+  result[size] = '\0';
+}
+
 static void encodeValue (double val, int32_t *previousIntVal,
                    char *result, unsigned *charCount)
 {
   /* Convert the current latitude and longitude to their integer
      representation. */
-  int32_t intVal = round (val * 1e5);
-  int32_t diffVal = intVal - *previousIntVal;
-  *previousIntVal = intVal;
-  
-  bool isNeg = diffVal < 0;
-  /* Shift the value right by 1 to make room for the sign bit on the right 
-     hand side. */
-  diffVal <<= 1;
-  
-  if (isNeg) {
-    /* As the value is stored as a twos compliment value small values have a 
-       lot of bits set so not the value. This will also flip the value of the
-       sign bit so when we come to decode the value we will know that it is 
-       negative. */
-    diffVal = ~diffVal;
+  encodeIntValue ((int32_t)round (val * 1e5), previousIntVal,
+                  result, charCount);
+}
+
+/* Writes the characters for a value whose sign has already been moved to
+   the lowest bit and returns how many there are. Shared by the 32 bit
+   differences of a polyline and the 64 bit ones in polylineDimensions.c. */
+static inline unsigned writeZigZagValue (uint64_t diffVal, char *result)
+{
+#if POLYLINE_ENCODE_TABLE
+  if (diffVal < ENCODE_TABLE_SIZE) {
+    /* Both characters are always copied, result has room for them. */
+    memcpy (result, encodeTable[diffVal], 2);
+    return 1 + (diffVal >= 32);
   }
+#endif
   
   unsigned count = 0;
   
@@ -344,54 +785,101 @@ static void encodeValue (double val, int32_t *previousIntVal,
     ++count;
   } while (diffVal);
 
+  return count;
+}
+
+/* Writes the characters for one difference and returns how many there
+   are, result needs room for 6 chars. */
+static inline unsigned encodeDifference (uint32_t diffVal, char *result)
+{
+  /* diffVal is unsigned so that the shifts below are well defined for
+     negative differences. */
+  bool isNeg = (int32_t)diffVal < 0;
+  
+  /* Shift the value right by 1 to make room for the sign bit on the right 
+     hand side. */
+  diffVal <<= 1;
+  
+  if (isNeg) {
+    /* As the value is stored as a twos compliment value small values have a 
+       lot of bits set so not the value. This will also flip the value of the
+       sign bit so when we come to decode the value we will know that it is 
+       negative. */
+    diffVal = ~diffVal;
+  }
+
+  return writeZigZagValue (diffVal, result);
+}
+
+static void encodeIntValue (int32_t intVal, int32_t *previousIntVal,
+                            char *result, unsigned *charCount)
+{
+  uint32_t diffVal = (uint32_t)intVal - (uint32_t)*previousIntVal;
+  *previousIntVal = intVal;
+  unsigned count = encodeDifference (diffVal, result);
+
   if (!charCount)
     printf ("required value `length` not set in `encodeIntValue`");
   else
     *charCount += count;
 }
 
-bool decodenValue (char *string, unsigned *usedChars,
-                   int32_t *previousIntValue, double *result,
-                   size_t n) {
+unsigned polylineWriteValue (int32_t intValue, int32_t previousIntValue,
+                             char *result)
+{
+  return encodeDifference ((uint32_t)intValue - (uint32_t)previousIntValue,
+                           result);
+}
+
+unsigned polylineWriteWideValue (int64_t difference, char *result)
+{
+  uint64_t value = (uint64_t)difference << 1;
+  if (difference < 0)
+    value = ~value;
+
+  return writeZigZagValue (value, result);
+}
+
+static bool decodenValue (const char *string, unsigned *usedChars,
+                          int32_t *previousIntValue, double *result,
+                          size_t n) {
   unsigned i = 0;
-  int32_t diff = 0;
+  uint32_t bits = 0;
   char currentByte;
 
-#if DEBUG
-  if (!usedChars) {
-    printf ("error: usedChars is cannot be NULL. "
-            "line %d file %s", __LINE__, __FILE__);
-    exit (1);
-  }
-#endif
-  
   do {
-    if (i >= n || string[i] == '\0')
+    /* A NUL isn't a polyline character either, callers tell the two
+       apart. */
+    if (i >= n || !isPolylineChar (string[i]))
       return false;
     
     currentByte = string[i] - 63;
-    diff |= (uint32_t)(currentByte & 0x1f) << (5 * i);
+    /* n can allow more characters than an int32_t needs, shifting by 32
+       or more is undefined so the extra bits are dropped. */
+    if (i < 7)
+      bits |= (uint32_t)(currentByte & 0x1f) << (5 * i);
     ++i;
   } while (currentByte & 0x20);
 
-  if (diff & 1) {
+  /* The lowest bit is the sign bit, negative values were notted when
+     they were encoded. */
+  int32_t diff = (int32_t)(bits >> 1);
+  if (bits & 1) {
     diff = ~diff;
   }
-
-  diff >>= 1;
   
-  *previousIntValue += diff;
+  *previousIntValue = (int32_t)((uint32_t)*previousIntValue + (uint32_t)diff);
   *result = *previousIntValue * 1e-5;
 
   *usedChars += i;
   return true;
 }
 
-bool PolylineEncoderDecodeNextCoord (PolylineEncoder *encoder,
-                                     char *encodedString,
-                                     size_t n,
-                                     Coordinate *returnVal,
-                                     unsigned *usedCharsCount)
+static bool PolylineEncoderDecodeNextCoord (PolylineEncoder *encoder,
+                                            const char *encodedString,
+                                            size_t n,
+                                            Coordinate *returnVal,
+                                            unsigned *usedCharsCount)
 {
   /* We need to be a little careful here as if we can't decode both
      locations we want to leave the intLat and intLng values as 
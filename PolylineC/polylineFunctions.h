@@ -9,6 +9,45 @@
 #ifndef googlePolylineTest_polylineFunctions_h
 #define googlePolylineTest_polylineFunctions_h
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The version of the library's interface. The minor version goes up when
+   functions are added, the major version when existing ones change, which
+   is also when the shared library's soname changes. */
+#define POLYLINE_VERSION_MAJOR 1
+#define POLYLINE_VERSION_MINOR 1
+#define POLYLINE_VERSION_PATCH 0
+#define POLYLINE_VERSION (POLYLINE_VERSION_MAJOR * 10000 \
+                          + POLYLINE_VERSION_MINOR * 100 \
+                          + POLYLINE_VERSION_PATCH)
+
+/* Returns POLYLINE_VERSION for the library that is actually loaded, which
+   may be newer than the headers the code was compiled with. */
+unsigned PolylineLibraryVersion (void);
+
+/* Returned by functions that can fail rather than exiting the process. */
+typedef enum PolylineStatus
+{
+  PolylineStatusSuccess = 0,
+  /* A required argument was NULL or out of range. */
+  PolylineStatusInvalidArgument,
+  /* The characters can't be part of a polyline. */
+  PolylineStatusMalformedInput,
+  PolylineStatusOutOfMemory
+} PolylineStatus;
+
+/* The most characters encoding a single coordinate can take. Only
+   latitudes from -90 to 90 and longitudes from -180 to 180 are encoded,
+   so the difference in longitude between two coordinates can be up to
+   360 degrees, which takes 6 characters, as can the latitude. */
+#define POLYLINE_MAX_COORDINATE_CHARS 12
+
 typedef struct Coordinate
 {
   double latitude;
@@ -20,63 +59,228 @@ typedef struct PolylineEncoder PolylineEncoder;
 
 /* Creates a polyline info structure so that you can stream locations for
    encoding, or chars for decoding into it. */
-PolylineEncoder *PolylineEncoderCreate ();
+PolylineEncoder *PolylineEncoderCreate (void);
 
 void PolylineEncoderFree (PolylineEncoder *encoder);
 
+/* Returns the encoder to the state it was in when it was created so it
+   can be reused for another polyline. Up to maxRetainedBytes of the memory
+   used to store encoded chars is kept to avoid allocating it again. The
+   memory is kept in whole nodes of 1024 chars (or 1024 Coordinates when
+   decoding), maxRetainedBytes is rounded up to a whole node and 0 frees
+   all of it. */
+void PolylineEncoderReset (PolylineEncoder *encoder, size_t maxRetainedBytes);
+
+/* The bytes the encoder holds for storing encoded chars or decoded
+   Coordinates, including the memory kept by PolylineEncoderReset. */
+size_t PolylineEncoderRetainedBytes (PolylineEncoder *encoder);
+
 /* Encodes a coordinate to a polyline string. If you have previously
    encoded a coordinate using this method it will encode the new
    coordinate as if you're continuing the polyline from the last coordinate
    encoded. result must have enough space to contain the characters, this is
-   at most 10 characters. 
+   at most POLYLINE_MAX_COORDINATE_CHARS characters. 
    returns the number characters that have been written to result. 
    Use this function if you want to manage the storage of the chars 
    yourself. If you use this function encoder WON'T store the encoded
    string, you shouldn't mix calls to this method with calls to 
-   PolylineEncoderEncodeCoordinate  with the same encoder. */
+   PolylineEncoderEncodeCoordinate  with the same encoder. Returns 0 if
+   result is NULL or the coordinate is out of range, a latitude outside
+   -90 to 90 or a longitude outside -180 to 180 (or NaN), leaving the
+   encoder as it was. */
 unsigned PolylineEncoderGetEncodedCoordinate (PolylineEncoder *encoder,
                                               Coordinate coord,
                                               char *result);
 
 /* Encodes a coordinate and appends the encoded character to the internal
    string respresentation, the entire encoded string can be got using
-   PolylineEncoderCopyEncodedString() */
-void PolylineEncoderEncodeCoordinate (PolylineEncoder *encoder, Coordinate coord);
+   PolylineEncoderCopyEncodedString(). Returns
+   PolylineStatusInvalidArgument, without appending anything, if the
+   coordinate is out of range (see PolylineEncoderGetEncodedCoordinate). */
+PolylineStatus PolylineEncoderEncodeCoordinate (PolylineEncoder *encoder,
+                                                Coordinate coord);
 
 /* Encoded a goup of coordinates. Use PolylineEncoderCopyEncodedString() to 
-   get the encoded string. */
-void PolylineEncoderEncodeCoordintates (PolylineEncoder *encoder,
-                                        Coordinate *coords,
-                                        unsigned coordCount);
+   get the encoded string. Stops at the first coordinate that is out of
+   range, the ones before it are still appended. */
+PolylineStatus PolylineEncoderEncodeCoordintates (PolylineEncoder *encoder,
+                                                  const Coordinate *coords,
+                                                  size_t coordCount);
 
 /* Returns the encoded polyline from the encoder. Your code has ownership
    of this string. */
 char *PolylineEncoderCopyEncodedString (PolylineEncoder *encoder);
 
+/* The length of the encoded polyline held by the encoder, not including
+   the NUL terminator. */
+size_t PolylineEncoderEncodedStringLength (PolylineEncoder *encoder);
+
+/* Copies the encoded polyline into result, which must have room for
+   PolylineEncoderEncodedStringLength () + 1 chars. Use this rather than
+   PolylineEncoderCopyEncodedString to avoid allocating the result. */
+void PolylineEncoderGetEncodedString (PolylineEncoder *encoder, char *result);
+
 /* Encodes all the coordinates passed to the function. 
-   Returns the encoded C string */
-char *copyEncodedLocationsString (Coordinate *coords, unsigned coordsCount);
+   Returns the encoded C string, or NULL if a coordinate is out of range
+   (see PolylineEncoderGetEncodedCoordinate) or the string couldn't be
+   allocated. */
+char *copyEncodedLocationsString (const Coordinate *coords, size_t coordsCount);
+
+/* The same as PolylineEncoderGetEncodedCoordinate but for a fixed point
+   coordinate, e.g. an E7 coordinate is given with unitsPerDegree 10000000.
+   The conversion to the polyline's 1e-5 precision only uses integer
+   arithmetic, so values exactly half way between two E5 values are
+   always rounded away from zero. Converting them to doubles first can
+   round them either way. Returns 0 if result is NULL, unitsPerDegree
+   isn't positive or the coordinate is out of range, the same range as
+   PolylineEncoderGetEncodedCoordinate in units of unitsPerDegree. */
+unsigned PolylineEncoderGetEncodedFixedPointCoordinate (PolylineEncoder *encoder,
+                                                        int32_t latitude,
+                                                        int32_t longitude,
+                                                        int32_t unitsPerDegree,
+                                                        char *result);
+
+/* Encodes coordsCount fixed point coordinates.
+   latLngs: The coordinates as latitude, longitude pairs.
+   unitsPerDegree: The scale of the values, 10000000 for E7 values, it
+                   must be positive.
+   Returns the encoded C string, or NULL if unitsPerDegree isn't positive,
+   a coordinate is out of range or the string couldn't be allocated. */
+char *copyEncodedFixedPointLocationsString (const int32_t *latLngs,
+                                            size_t coordsCount,
+                                            int32_t unitsPerDegree);
 
-void PolylineEncoderDecoderCoordinates (PolylineEncoder *encoder,
-                                        char *encodedString,
-                                        unsigned *decodedCoordCount);
+/* Encodes coordsCount coordinates given as latitude, longitude pairs of
+   floats. Returns the encoded C string, or NULL if a coordinate is out of
+   range or the string couldn't be allocated. */
+char *copyEncodedFloatLocationsString (const float *latLngs,
+                                       size_t coordsCount);
+
+/* Decodes as many Coordinates as possible from encodedString and adds
+   them to the ones held by the encoder, like
+   PolylineEncoderGetDecodedCoordinates but without taking them out of the
+   encoder. decodedCoordCount is set to the number of coordinates added.
+   Returns PolylineStatusMalformedInput if the characters can't be a
+   polyline, one is outside '?' to '~' or a coordinate is longer than
+   POLYLINE_MAX_COORDINATE_CHARS, the coordinates before the bad
+   characters are still added.
+   The encoder should be reset before decoding another polyline with it,
+   decodeDamagedLocationsString can salvage more of a damaged one. */
+PolylineStatus PolylineEncoderDecodeCoordinates (PolylineEncoder *encoder,
+                                                 const char *encodedString,
+                                                 size_t *decodedCoordCount);
 
 /* Decodes as many Coordinates as possible from the passed in string.
    PolylineEncoder: The encoder being used to decode the string.
    encodedString: The string section to decode, this doesn't have to
                   be the whole of the string.
-   decodedCoordCount: The number of coordinates that have been decoded.
-   return: returns a pointer to the decoded coordinates.
+   decodedCount: The number of coordinates that have been decoded.
+   status: If it isn't NULL it's set to the result of decoding, if the
+           string is malformed the coordinates before the bad characters
+           are returned.
+   return: returns a pointer to the decoded coordinates, or NULL if there
+           weren't any. Your code has ownership of them.
    discussion: In the case that you're sending the string in chunks
                the encoder man not be able to decode the last few charaters,
                the encoder will keep a copy of these chars and prepend them
                to the next chunk, so you don't need to worry about resending
                them yourself. */
 Coordinate *PolylineEncoderGetDecodedCoordinates (PolylineEncoder *encoder,
-                                                  char *encodedString,
-                                                  unsigned *decodedCount);
+                                                  const char *encodedString,
+                                                  size_t *decodedCount,
+                                                  PolylineStatus *status);
+
+/* Decodes the polyline c string back into its coordinates. Returns NULL,
+   with locsCount set to 0, if there aren't any coordinates or the string
+   is malformed. */
+Coordinate *decodeLocationsString (const char *polylineString,
+                                   size_t *locsCount);
+
+/* What decodeDamagedLocationsString found wrong with a polyline. */
+typedef struct PolylineDamageReport
+{
+  /* The offset of the first character that can't be part of a polyline,
+     one outside '?' to '~' or a value running on for more than 6
+     characters. The string's length if there isn't one. */
+  size_t errorOffset;
+  /* The characters before the first damaged or incomplete coordinate. */
+  size_t validLength;
+  /* The coordinates decoded from those characters, which are exact. When
+     resyncing the ones after them were decoded past a damaged value, which
+     was taken as a difference of 0, so they may all be offset from where
+     they should be. */
+  size_t validCount;
+  /* The number of damaged values, only more than 1 when resyncing. */
+  size_t damagedValueCount;
+  /* True if the string ended part way through a coordinate. */
+  bool truncated;
+} PolylineDamageReport;
+
+/* Decodes a polyline that may be truncated or have damaged characters,
+   e.g. one read back from a log, without failing on the damage. This
+   checks every character so it's slower than decodeLocationsString, use
+   it on strings that decodeLocationsString has rejected, or when the
+   report is wanted.
+   length: The number of characters in polylineString, a NUL before then
+           counts as a damaged character.
+   resync: If false decoding stops at the first damaged value and only the
+           coordinates before it are returned. If true it carries on from
+           the end of the damaged value, so the rest of the coordinates
+           keep their shape, see PolylineDamageReport.validCount.
+   report: Set to what was wrong with the polyline, may be NULL.
+   return: The decoded coordinates, or NULL if there weren't any or the
+           memory couldn't be allocated. Your code has ownership of them. */
+Coordinate *decodeDamagedLocationsString (const char *polylineString,
+                                          size_t length,
+                                          bool resync,
+                                          size_t *locsCount,
+                                          PolylineDamageReport *report);
+
+/* Decodes a polyline a coordinate at a time, without allocating anything.
+   Only the characters for the coordinates that are asked for are decoded,
+   so it's cheap to read the start of a long polyline and stop.
+   The cursor can be declared on the stack and set up with
+   PolylineCursorInit, it doesn't need freeing:
+
+   PolylineCursor cursor;
+   Coordinate coord;
+   PolylineCursorInit (&cursor, encodedString, strlen (encodedString));
+   while (PolylineCursorNext (&cursor, &coord)) {
+     // Use coord in some way.
+     ...
+   }
+*/
+typedef struct PolylineCursor
+{
+  const char *position;
+  const char *end;
+  int32_t intLat;
+  int32_t intLng;
+} PolylineCursor;
+
+/* Points the cursor at the start of encodedString, which must stay valid
+   while the cursor is used. Reading also stops at a NUL character. */
+void PolylineCursorInit (PolylineCursor *cursor, const char *encodedString,
+                         size_t length);
+
+/* Decodes the next coordinate into coord. Returns false at the end of the
+   string, an incomplete coordinate at the end is not returned. */
+bool PolylineCursorNext (PolylineCursor *cursor, Coordinate *coord);
+
+/* Decodes up to n coordinates into coords.
+   Returns the number of coordinates decoded, less than n at the end. */
+size_t PolylineCursorNextN (PolylineCursor *cursor, Coordinate *coords,
+                            size_t n);
 
-/* Decodes the polyline c string back into its coordinates. */
-Coordinate *decodeLocationsString (char *polylineString, unsigned *locsCount);
+/* Moves past up to n coordinates without converting them to doubles.
+   Returns the number of coordinates skipped. */
+size_t PolylineCursorSkip (PolylineCursor *cursor, size_t n);
+
+/* The number of characters the cursor hasn't read yet. */
+size_t PolylineCursorRemainingBytes (const PolylineCursor *cursor);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -0,0 +1,108 @@
+//
+//  polylineVarint.h
+//  googlePolylineTest
+//
+//  Helpers for code that walks the encoded characters of a polyline
+//  directly rather than going through a PolylineEncoder. These aren't
+//  part of the public interface, include polylineFunctions.h instead.
+//
+
+#ifndef googlePolylineTest_polylineVarint_h
+#define googlePolylineTest_polylineVarint_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Marks a function whose loops should be vectorised. With GCC on x86-64
+   an AVX2 version is also built, and the version to use is picked by the
+   dynamic linker when the library is loaded. */
+#if defined (__GNUC__) && !defined (__clang__) && defined (__x86_64__) \
+    && defined (__ELF__)
+#define POLYLINE_VECTOR_KERNEL \
+  __attribute__ ((target_clones ("avx2", "default"), \
+                  optimize ("vect-cost-model=dynamic")))
+#else
+#define POLYLINE_VECTOR_KERNEL
+#endif
+
+/* Counts the characters that end a value in the first length characters
+   of string, i.e. the number of complete values. This is the same test
+   polylineReadValue uses so the counts always agree. */
+size_t polylineCountValues (const char *string, size_t length);
+
+/* Counts the characters outside '?' to '~' in the first length characters
+   of string, NULs included. A polyline that has any is malformed. */
+size_t polylineCountBadChars (const char *string, size_t length);
+
+/* Writes the characters for the difference between intValue and
+   previousIntValue, the running integer (E5) values for a latitude or
+   longitude, and returns how many were written. result needs room for 6
+   chars, the same encoding as PolylineEncoderGetEncodedCoordinate. */
+unsigned polylineWriteValue (int32_t intValue, int32_t previousIntValue,
+                             char *result);
+
+/* The same as polylineWriteValue for a 64 bit difference, as used by
+   polylineDimensions.h. result needs room for 13 chars. */
+unsigned polylineWriteWideValue (int64_t difference, char *result);
+
+/* Reads the next difference value from *string and adds it to *intValue.
+   string: Points at the first character of the value. On success it is
+           moved past the characters that were used.
+   end: One past the last character that may be read. Pass NULL if the
+        string is NUL terminated, reading also stops at a NUL character.
+   intValue: The running integer (E5) value for this latitude or longitude.
+   return: false if the value is incomplete, in which case neither *string
+           nor *intValue are changed. */
+static inline bool polylineReadValue (const char **string, const char *end,
+                                      int32_t *intValue)
+{
+  const char *position = *string;
+  uint32_t diff = 0;
+  unsigned shift = 0;
+  int currentByte;
+
+  do {
+    if (position == end || *position == '\0')
+      return false;
+
+    currentByte = *position++ - 63;
+    if (shift < 32)
+      diff |= (uint32_t)(currentByte & 0x1f) << shift;
+    shift += 5;
+  } while (currentByte & 0x20);
+
+  /* The lowest bit is the sign bit, negative values were notted when
+     they were encoded. */
+  int32_t value = (int32_t)(diff >> 1);
+  if (diff & 1)
+    value = ~value;
+
+  /* Added as unsigned so a damaged string wraps rather than overflowing. */
+  *intValue = (int32_t)((uint32_t)*intValue + (uint32_t)value);
+  *string = position;
+  return true;
+}
+
+/* Reads the next latitude and longitude differences, only updating
+   *intLat and *intLng if both values were complete. */
+static inline bool polylineReadCoordinate (const char **string,
+                                           const char *end,
+                                           int32_t *intLat,
+                                           int32_t *intLng)
+{
+  const char *position = *string;
+  int32_t lat = *intLat;
+  int32_t lng = *intLng;
+
+  if (!polylineReadValue (&position, end, &lat)
+      || !polylineReadValue (&position, end, &lng))
+    return false;
+
+  *intLat = lat;
+  *intLng = lng;
+  *string = position;
+  return true;
+}
+
+#endif
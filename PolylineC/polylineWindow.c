@@ -0,0 +1,271 @@
+//
+//  polylineWindow.c
+//  googlePolylineTest
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "polylineWindow.h"
+#include "polylineVarint.h"
+
+/* The points of a window are split in two. The first point is kept as its
+   integer (E5) values and only encoded when the polyline is asked for.
+   Every later point is kept as the characters for its difference from the
+   point before, in a ring buffer of characters. A second ring holds the
+   number of characters each of those points used, so the oldest can be
+   found when it's dropped. Dropping the first point decodes the next
+   point's difference and adds it to the first point's values, which makes
+   it the new first point. */
+struct PolylineWindow {
+  int32_t firstLat;
+  int32_t firstLng;
+  int32_t lastLat;
+  int32_t lastLng;
+  /* Including the first point. */
+  size_t pointCount;
+  size_t pointCapacity;
+  /* The index in lengths of the second point. */
+  size_t lengthStart;
+  /* The index in bytes of the second point's characters. */
+  size_t byteStart;
+  size_t byteCount;
+  size_t byteCapacity;
+  /* pointCapacity - 1 lengths followed by byteCapacity characters. */
+  unsigned char data[];
+};
+
+static unsigned char *windowLengths (const PolylineWindow *window)
+{
+  return (unsigned char *)window->data;
+}
+
+static char *windowBytes (const PolylineWindow *window)
+{
+  return (char *)window->data + window->pointCapacity - 1;
+}
+
+/* Copies length characters starting at index start of the ring, which
+   may wrap round its end. */
+static void copyFromRing (const PolylineWindow *window, size_t start,
+                          size_t length, char *result)
+{
+  const char *bytes = windowBytes (window);
+  size_t untilEnd = window->byteCapacity - start;
+  if (length <= untilEnd) {
+    memcpy (result, bytes + start, length);
+  } else {
+    memcpy (result, bytes + start, untilEnd);
+    memcpy (result + untilEnd, bytes, length - untilEnd);
+  }
+}
+
+static void copyToRing (PolylineWindow *window, size_t start,
+                        const char *characters, size_t length)
+{
+  char *bytes = windowBytes (window);
+  size_t untilEnd = window->byteCapacity - start;
+  if (length <= untilEnd) {
+    memcpy (bytes + start, characters, length);
+  } else {
+    memcpy (bytes + start, characters, untilEnd);
+    memcpy (bytes, characters + untilEnd, length - untilEnd);
+  }
+}
+
+static size_t worstCaseBytes (size_t pointCapacity)
+{
+  return pointCapacity > 1
+         ? (pointCapacity - 1) * POLYLINE_MAX_COORDINATE_CHARS
+         : POLYLINE_MAX_COORDINATE_CHARS;
+}
+
+size_t PolylineWindowMemorySize (size_t pointCapacity, size_t byteCapacity)
+{
+  if (!pointCapacity
+      || pointCapacity > SIZE_MAX / 4 / POLYLINE_MAX_COORDINATE_CHARS)
+    return 0;
+
+  if (!byteCapacity)
+    byteCapacity = worstCaseBytes (pointCapacity);
+
+  if (byteCapacity < POLYLINE_MAX_COORDINATE_CHARS
+      || byteCapacity > SIZE_MAX / 4)
+    return 0;
+
+  return sizeof (PolylineWindow) + pointCapacity - 1 + byteCapacity;
+}
+
+PolylineWindow *PolylineWindowInit (void *memory, size_t pointCapacity,
+                                    size_t byteCapacity)
+{
+  if (!memory || !PolylineWindowMemorySize (pointCapacity, byteCapacity))
+    return NULL;
+
+  PolylineWindow *window = memory;
+  window->pointCapacity = pointCapacity;
+  window->byteCapacity = byteCapacity ? byteCapacity
+                                      : worstCaseBytes (pointCapacity);
+  PolylineWindowClear (window);
+  return window;
+}
+
+PolylineWindow *PolylineWindowCreate (size_t pointCapacity,
+                                      size_t byteCapacity)
+{
+  size_t size = PolylineWindowMemorySize (pointCapacity, byteCapacity);
+  if (!size)
+    return NULL;
+
+  return PolylineWindowInit (malloc (size), pointCapacity, byteCapacity);
+}
+
+void PolylineWindowFree (PolylineWindow *window)
+{
+  free (window);
+}
+
+void PolylineWindowClear (PolylineWindow *window)
+{
+  window->pointCount = 0;
+  window->lengthStart = 0;
+  window->byteStart = 0;
+  window->byteCount = 0;
+}
+
+/* Drops the first point, the window must have at least one point. */
+static void removeFirstPoint (PolylineWindow *window)
+{
+  if (window->pointCount == 1) {
+    PolylineWindowClear (window);
+    return;
+  }
+
+  /* Copy the second point's characters out of the ring so that they can
+     be decoded even if they wrap round the end of it. */
+  unsigned length = windowLengths (window)[window->lengthStart];
+  char characters[POLYLINE_MAX_COORDINATE_CHARS];
+  copyFromRing (window, window->byteStart, length, characters);
+
+  const char *position = characters;
+  polylineReadCoordinate (&position, characters + length,
+                          &window->firstLat, &window->firstLng);
+
+  window->byteStart += length;
+  if (window->byteStart >= window->byteCapacity)
+    window->byteStart -= window->byteCapacity;
+  window->byteCount -= length;
+
+  if (++window->lengthStart == window->pointCapacity - 1)
+    window->lengthStart = 0;
+  --window->pointCount;
+}
+
+size_t PolylineWindowRemoveOldest (PolylineWindow *window, size_t count)
+{
+  if (count > window->pointCount)
+    count = window->pointCount;
+
+  for (size_t i = 0; i < count; ++i)
+    removeFirstPoint (window);
+
+  return count;
+}
+
+PolylineStatus PolylineWindowAppend (PolylineWindow *window, Coordinate coord)
+{
+  /* Anything further out takes more than POLYLINE_MAX_COORDINATE_CHARS
+     and doesn't fit in an int32_t. */
+  if (!(fabs (coord.latitude) <= 90 && fabs (coord.longitude) <= 180))
+    return PolylineStatusInvalidArgument;
+
+  int32_t intLat = (int32_t)round (coord.latitude * 1e5);
+  int32_t intLng = (int32_t)round (coord.longitude * 1e5);
+
+  if (!window->pointCount || window->pointCapacity == 1) {
+    PolylineWindowClear (window);
+    window->firstLat = window->lastLat = intLat;
+    window->firstLng = window->lastLng = intLng;
+    window->pointCount = 1;
+    return PolylineStatusSuccess;
+  }
+
+  char characters[POLYLINE_MAX_COORDINATE_CHARS];
+  unsigned length = polylineWriteValue (intLat, window->lastLat, characters);
+  length += polylineWriteValue (intLng, window->lastLng, characters + length);
+
+  /* The last point is never dropped here, as long as there are points
+     after the first there are characters to free, and byteCapacity always
+     has room for one point. */
+  if (window->pointCount == window->pointCapacity)
+    removeFirstPoint (window);
+  while (window->byteCapacity - window->byteCount < length)
+    removeFirstPoint (window);
+
+  size_t lengthEnd = window->lengthStart + window->pointCount - 1;
+  if (lengthEnd >= window->pointCapacity - 1)
+    lengthEnd -= window->pointCapacity - 1;
+  windowLengths (window)[lengthEnd] = (unsigned char)length;
+
+  size_t byteEnd = window->byteStart + window->byteCount;
+  if (byteEnd >= window->byteCapacity)
+    byteEnd -= window->byteCapacity;
+  copyToRing (window, byteEnd, characters, length);
+
+  window->byteCount += length;
+  window->lastLat = intLat;
+  window->lastLng = intLng;
+  ++window->pointCount;
+  return PolylineStatusSuccess;
+}
+
+size_t PolylineWindowPointCount (const PolylineWindow *window)
+{
+  return window->pointCount;
+}
+
+/* Encodes the first point, which is a difference from 0. */
+static unsigned encodeFirstPoint (const PolylineWindow *window, char *result)
+{
+  unsigned length = polylineWriteValue (window->firstLat, 0, result);
+  return length + polylineWriteValue (window->firstLng, 0, result + length);
+}
+
+size_t PolylineWindowEncodedLength (const PolylineWindow *window)
+{
+  if (!window->pointCount)
+    return 0;
+
+  char first[POLYLINE_MAX_COORDINATE_CHARS];
+  return encodeFirstPoint (window, first) + window->byteCount;
+}
+
+void PolylineWindowGetEncodedString (const PolylineWindow *window,
+                                     char *result)
+{
+  if (!window->pointCount) {
+    result[0] = '\0';
+    return;
+  }
+
+  /* The first point goes through a buffer as its characters may be fewer
+     than encoding writes. */
+  char first[POLYLINE_MAX_COORDINATE_CHARS];
+  size_t length = encodeFirstPoint (window, first);
+  memcpy (result, first, length);
+
+  copyFromRing (window, window->byteStart, window->byteCount,
+                result + length);
+  result[length + window->byteCount] = '\0';
+}
+
+char *PolylineWindowCopyEncodedString (const PolylineWindow *window)
+{
+  char *result = malloc (PolylineWindowEncodedLength (window) + 1);
+  if (result)
+    PolylineWindowGetEncodedString (window, result);
+
+  return result;
+}
@@ -0,0 +1,87 @@
+//
+//  polylineWindow.h
+//  googlePolylineTest
+//
+//  Keeps the most recent points of a live track as a polyline, e.g. the
+//  last few minutes of a vehicle's position for a map. The encoded
+//  differences are kept in a ring buffer so appending a point and
+//  dropping the oldest one don't re-encode the rest of the track, and
+//  each window lives in a single fixed size block of memory.
+//
+
+#ifndef googlePolylineTest_polylineWindow_h
+#define googlePolylineTest_polylineWindow_h
+
+#include <stddef.h>
+
+#include "polylineFunctions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct PolylineWindow;
+typedef struct PolylineWindow PolylineWindow;
+
+/* The bytes a window needs, for sizing memory given to PolylineWindowInit.
+   pointCapacity: The most points the window holds, once it's full
+                  appending a point drops the oldest one.
+   byteCapacity: The most encoded characters kept for the differences
+                 between the points, if appending a point needs more the
+                 oldest points are dropped until it fits. 0 uses the worst
+                 case, POLYLINE_MAX_COORDINATE_CHARS per point, otherwise
+                 it must be at least POLYLINE_MAX_COORDINATE_CHARS. A
+                 dense GPS track takes about 4 characters per point.
+   return: 0 if the capacities aren't valid. */
+size_t PolylineWindowMemorySize (size_t pointCapacity, size_t byteCapacity);
+
+/* Creates an empty window in memory, which must have room for
+   PolylineWindowMemorySize () bytes and be aligned as malloc would align
+   it. This lets many windows share one allocation, nothing needs to be
+   freed other than memory itself. Returns NULL if the capacities aren't
+   valid. */
+PolylineWindow *PolylineWindowInit (void *memory, size_t pointCapacity,
+                                    size_t byteCapacity);
+
+/* The same as PolylineWindowInit with memory from malloc, free the window
+   with PolylineWindowFree. Returns NULL if the capacities aren't valid or
+   the memory couldn't be allocated. */
+PolylineWindow *PolylineWindowCreate (size_t pointCapacity,
+                                      size_t byteCapacity);
+
+void PolylineWindowFree (PolylineWindow *window);
+
+/* Adds coord to the end of the track, dropping the oldest points if the
+   window is full. Takes constant time.
+   return: PolylineStatusInvalidArgument if the latitude isn't from -90 to
+           90 or the longitude from -180 to 180, the window is unchanged. */
+PolylineStatus PolylineWindowAppend (PolylineWindow *window, Coordinate coord);
+
+/* Drops up to count of the oldest points, e.g. the ones older than the
+   time the track should cover, and returns how many were dropped. Each
+   point takes constant time. */
+size_t PolylineWindowRemoveOldest (PolylineWindow *window, size_t count);
+
+/* Drops every point. */
+void PolylineWindowClear (PolylineWindow *window);
+
+size_t PolylineWindowPointCount (const PolylineWindow *window);
+
+/* The length of the window's polyline, not including the NUL terminator. */
+size_t PolylineWindowEncodedLength (const PolylineWindow *window);
+
+/* Copies the window's polyline into result, which must have room for
+   PolylineWindowEncodedLength () + 1 chars. Only the first point is
+   encoded, the rest is copied from the ring buffer. */
+void PolylineWindowGetEncodedString (const PolylineWindow *window,
+                                     char *result);
+
+/* Returns the window's polyline, your code has ownership of the string.
+   Returns NULL if it couldn't be allocated. */
+char *PolylineWindowCopyEncodedString (const PolylineWindow *window);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
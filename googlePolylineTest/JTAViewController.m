@@ -81,13 +81,13 @@ struct PolylineEncoder {
     exampleFileStr = nil;
     
     char *encodeAll = copyEncodedLocationsString((Coordinate *)recordedLocs,
-                                                 (int)recordedLocsCount);
+                                                 recordedLocsCount);
     BOOL passedTest = [encodedPolyline isEqualToString:
                        [NSString stringWithUTF8String:encodeAll]];
     
     
     if (passedTest) {
-      unsigned locsCount;
+      size_t locsCount;
       CLLocationCoordinate2D *coords
        = (CLLocationCoordinate2D *)decodeLocationsString(encodeAll, &locsCount);
       if (locsCount == recordedLocsCount) {
@@ -135,7 +135,7 @@ struct PolylineEncoder {
   if (!encoder)
     encoder = PolylineEncoderCreate();
   
-  char encoded[11];
+  char encoded[POLYLINE_MAX_COORDINATE_CHARS + 1];
   
   Coordinate coord;
   coord.latitude = loc.latitude;
@@ -149,12 +149,15 @@ struct PolylineEncoder {
   
   encoded[len] = '\0';
   
-  unsigned decodedCount = 0;
+  size_t decodedCount = 0;
   /* Make a temporary encoder to decode only the string segment that 
      we just encoded without the context of the rest of the string. */
   PolylineEncoder *tmpEncoder = PolylineEncoderCreate();
-  PolylineEncoderGetDecodedCoordinates(tmpEncoder, encoded,
-                                       &decodedCount);
+  Coordinate *decoded = PolylineEncoderGetDecodedCoordinates(tmpEncoder,
+                                                             encoded,
+                                                             &decodedCount,
+                                                             NULL);
+  free(decoded);
   
 
   int32_t latDiff = encoder->intLat - previousIntLat;
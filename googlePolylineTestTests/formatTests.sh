@@ -0,0 +1,141 @@
+#!/bin/sh
+#
+#  formatTests.sh
+#  googlePolylineTestTests
+#
+#  Tests PolylineTool's -F formats, `make test` in the PolylineC folder runs
+#  it with the path of PolylineTool. The checks that fail are printed and
+#  the exit status is 1 if there were any.
+#
+
+tool=${1:-./PolylineTool}
+failures=0
+
+# The example from Google's description of the format, as polylines and as
+# the doubles (little endian hex) of its coordinates.
+example='_p~iF~ps|U_ulLnnqC_mqNvxq`@'
+lat1=0000000000404340
+lng1=CDCCCCCCCC0C5EC0
+lat2=9A99999999594440
+lng2=CDCCCCCCCC3C5EC0
+lat3=C74B378941A04540
+lng3=A345B6F3FD9C5FC0
+exampleLine="[[-120.2,38.5],[-120.95,40.7],[-126.453,43.252]]"
+
+# check <name> <expected output> <tool arguments...>, stdin is the input.
+check () {
+  name=$1
+  expected=$2
+  shift 2
+  if ! output=$("$tool" "$@" 2>&1); then
+    echo "$name: PolylineTool failed: $output" >&2
+    failures=$((failures + 1))
+  elif [ "$output" != "$expected" ]; then
+    echo "$name: expected '$expected' but got '$output'" >&2
+    failures=$((failures + 1))
+  fi
+}
+
+# reject <name> <tool arguments...>, the input must be refused.
+reject () {
+  name=$1
+  shift
+  if "$tool" "$@" > /dev/null 2>&1; then
+    echo "$name: PolylineTool accepted bad input" >&2
+    failures=$((failures + 1))
+  fi
+}
+
+# GeoJSON
+check "GeoJSON LineString" "$example" -F geojson <<EOF
+{"type": "LineString", "coordinates": $exampleLine}
+EOF
+check "GeoJSON coordinates before type" "$example" -F geojson <<EOF
+{"coordinates": $exampleLine, "type": "LineString"}
+EOF
+check "GeoJSON decode LineString" \
+  "{\"type\":\"LineString\",\"coordinates\":$exampleLine}" -d -F geojson <<EOF
+$example
+EOF
+
+multi=$(printf '%s\n%s\n' "$example" "_p~iF~ps|U" \
+        | "$tool" -d -F geojson)
+check "GeoJSON MultiLineString round trip" \
+  "$(printf '%s\n%s' "$example" "_p~iF~ps|U")" -F geojson <<EOF
+$multi
+EOF
+
+check "GeoJSON Feature" "$example" -F geojson <<EOF
+{"type": "FeatureCollection", "features": [{"type": "Feature",
+ "properties": {"name": "route"},
+ "geometry": {"type": "LineString", "coordinates": $exampleLine}}]}
+EOF
+
+for number in nan NaN inf -Infinity 0x1p3 1e999; do
+  reject "GeoJSON $number" -F geojson <<EOF
+{"type": "LineString", "coordinates": [[$number, 38.5]]}
+EOF
+done
+
+check "GeoJSON extremes" "_cidP_gsia@~fsia@~ngtcA" -F geojson <<EOF
+{"type": "LineString", "coordinates": [[180, 90], [-180, -90]]}
+EOF
+for point in "[1e10, 1e10]" "[180.5, 38.5]" "[-120.2, -90.5]"; do
+  reject "GeoJSON out of range $point" -F geojson <<EOF
+{"type": "LineString", "coordinates": [[-120.2, 38.5], $point]}
+EOF
+done
+
+# WKB
+check "hex WKB LineString" "$example" -F hexwkb <<EOF
+010200000003000000$lng1$lat1$lng2$lat2$lng3$lat3
+EOF
+check "hex WKB big endian" "_p~iF~ps|U_ulLnnqC" -F hexwkb <<EOF
+000000000200000002C05E0CCCCCCCCCCD4043400000000000C05E3CCCCCCCCCCD404459999999999A
+EOF
+check "hex EWKB with SRID and Z" "_p~iF~ps|U_ulLnnqC" -F hexewkb <<EOF
+01020000A0E610000002000000${lng1}${lat1}0000000000000000${lng2}${lat2}000000000000F03F
+EOF
+check "hex WKB MultiLineString" "$(printf '%s\n%s' "$example" "_p~iF~ps|U")" \
+  -F hexwkb <<EOF
+010500000002000000010200000003000000$lng1$lat1$lng2$lat2$lng3${lat3}\
+010200000001000000$lng1$lat1
+EOF
+
+check "hex EWKB decode" \
+  "0102000020E610000003000000$lng1$lat1$lng2$lat2$lng3$lat3" -d -F hexewkb <<EOF
+$example
+EOF
+
+binary=PolylineFormatsTest.$$
+printf '%s\n%s\n' "$example" "_p~iF~ps|U" | "$tool" -d -F wkb > "$binary"
+check "binary WKB round trip" "$(printf '%s\n%s' "$example" "_p~iF~ps|U")" \
+  -F wkb -i "$binary"
+rm -f "$binary"
+
+reject "hex WKB truncated" -F hexwkb <<EOF
+010200000002000000$lng1$lat1$lng2
+EOF
+reject "hex WKB point count too large" -F hexwkb <<EOF
+010200000003000000$lng1$lat1$lng2$lat2
+EOF
+reject "hex WKB trailing bytes" -F hexwkb <<EOF
+010200000001000000$lng1${lat1}0102
+EOF
+reject "hex WKB NaN" -F hexwkb <<EOF
+010200000001000000${lng1}000000000000F87F
+EOF
+reject "hex WKB infinity" -F hexwkb <<EOF
+010200000001000000000000000000F0FF$lat1
+EOF
+reject "hex WKB latitude 1e10" -F hexwkb <<EOF
+010200000001000000${lng1}000000205FA00242
+EOF
+reject "hex EWKB web mercator SRID" -F hexewkb <<EOF
+0102000020110F000001000000$lng1$lat1
+EOF
+
+if [ "$failures" -ne 0 ]; then
+  echo "$failures format checks failed" >&2
+  exit 1
+fi
@@ -131,7 +131,7 @@ double rawCoords[] = {
   NSMutableString *streamedStr = [NSMutableString string];
   PolylineEncoder *encoder = PolylineEncoderCreate();
   for (int i = 0; i < coordsCount; ++i) {
-    char result[11];
+    char result[POLYLINE_MAX_COORDINATE_CHARS + 1];
     unsigned charCount = PolylineEncoderGetEncodedCoordinate(encoder,
                                                              coords[i],
                                                              result);
@@ -147,7 +147,7 @@ double rawCoords[] = {
   NSRange leftOver = NSMakeRange(0, [streamedStr length]);
   Coordinate *convertedCoords = malloc (sizeof(Coordinate) * coordsCount);
   Coordinate *convertedPtr = convertedCoords;
-  unsigned decodedCount = 0;
+  size_t decodedCount = 0;
   
   do {
     if (![streamedStr getBytes:buffer maxLength:127 usedLength:&usedLen
@@ -160,9 +160,11 @@ double rawCoords[] = {
     
     Coordinate *decoded = PolylineEncoderGetDecodedCoordinates(decoder,
                                                                buffer,
-                                                               &decodedCount);
+                                                               &decodedCount,
+                                                               NULL);
     memcpy(convertedPtr, decoded, decodedCount * sizeof(Coordinate));
     convertedPtr += decodedCount;
+    free(decoded);
   } while (YES);
   
   for (int i = 0; i < coordsCount; ++i) {
@@ -173,4 +175,53 @@ double rawCoords[] = {
   }
 }
 
+- (void)testFixedPointEncoding {
+  char *expected = copyEncodedLocationsString(coords, coordsCount);
+  int32_t *e5Coords = malloc (sizeof(int32_t) * 2 * coordsCount);
+  int32_t *e7Coords = malloc (sizeof(int32_t) * 2 * coordsCount);
+  for (int i = 0; i < coordsCount; ++i) {
+    e5Coords[i * 2] = round (coords[i].latitude * 1e5);
+    e5Coords[i * 2 + 1] = round (coords[i].longitude * 1e5);
+    e7Coords[i * 2] = e5Coords[i * 2] * 100;
+    e7Coords[i * 2 + 1] = e5Coords[i * 2 + 1] * 100;
+  }
+
+  char *e5Encoded = copyEncodedFixedPointLocationsString(e5Coords, coordsCount,
+                                                         100000);
+  char *e7Encoded = copyEncodedFixedPointLocationsString(e7Coords, coordsCount,
+                                                         10000000);
+  XCTAssert(strcmp(expected, e5Encoded) == 0, @"E5 encoding doesn't match");
+  XCTAssert(strcmp(expected, e7Encoded) == 0, @"E7 encoding doesn't match");
+
+  free(expected);
+  free(e5Encoded);
+  free(e7Encoded);
+  free(e5Coords);
+  free(e7Coords);
+}
+
+- (void)testCursor {
+  char *encoded = copyEncodedLocationsString(coords, coordsCount);
+  PolylineCursor cursor;
+  PolylineCursorInit(&cursor, encoded, strlen(encoded));
+
+  XCTAssert(PolylineCursorSkip(&cursor, 5) == 5, @"Failed to skip coordinates");
+
+  Coordinate buffer[7];
+  int i = 5;
+  size_t count;
+  while ((count = PolylineCursorNextN(&cursor, buffer, 7))) {
+    for (size_t j = 0; j < count; ++j, ++i) {
+      BOOL success = buffer[j].latitude == round (coords[i].latitude * 1e5) * 1e-5
+      && buffer[j].longitude == round(coords[i].longitude * 1e5) * 1e-5;
+      XCTAssert (success, @"Assertion failure on coordinate %d", i);
+    }
+  }
+
+  XCTAssert(i == coordsCount, @"Cursor decoded %d coordinates", i);
+  XCTAssert(PolylineCursorRemainingBytes(&cursor) == 0,
+            @"Cursor didn't read the whole string");
+  free(encoded);
+}
+
 @end
@@ -0,0 +1,139 @@
+//
+//  polylineHppTests.cpp
+//  googlePolylineTestTests
+//
+//  Compares the constexpr encoding and decoding in polyline.hpp with the C
+//  functions on the same inputs, `make test` in the PolylineC folder
+//  builds it with -std=c++17 and runs it. The checks that fail are printed
+//  and the exit status is 1 if there were any.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "polyline.hpp"
+
+static int failureCount;
+
+#define CHECK(condition, ...) \
+  do { \
+    if (!(condition)) { \
+      std::fprintf (stderr, "%s:%d: ", __func__, __LINE__); \
+      std::fprintf (stderr, __VA_ARGS__); \
+      std::fputc ('\n', stderr); \
+      ++failureCount; \
+    } \
+  } while (0)
+
+/* The same GPS like track as testTrack in polylineTests.c, made by the
+   compiler, with a jump every so often so the differences take from 2 to
+   12 characters. */
+template <std::size_t N>
+constexpr std::array<Coordinate, N> constexprTrack (unsigned seed)
+{
+  std::array<Coordinate, N> coords {};
+  double lat = 37.33415, lng = -122.078384;
+  for (std::size_t i = 0; i < N; ++i) {
+    seed = seed * 1103515245 + 12345;
+    lat += (static_cast<int> (seed >> 16 & 0x3ff) - 512) * 1e-6;
+    seed = seed * 1103515245 + 12345;
+    lng += (static_cast<int> (seed >> 16 & 0x3ff) - 512) * 1e-6;
+    coords[i].latitude = i % 37 == 5 ? lat - 50 : lat;
+    coords[i].longitude = i % 53 == 7 ? lng + 170 : lng;
+  }
+
+  return coords;
+}
+
+constexpr auto track = constexprTrack<500> (7);
+constexpr auto encodedTrack = POLYLINE_ENCODE (track);
+constexpr auto decodedTrack = POLYLINE_DECODE (encodedTrack.data ());
+
+/* Values that round differently if 0.5 is added before truncating,
+   4.9999999999999996e-06 * 1e5 is 0.49999999999999994. Also halves,
+   the extremes and values either side of 0. */
+constexpr std::array<Coordinate, 10> roundingCoords {{
+  { 4.9999999999999996e-06, -4.9999999999999996e-06 },
+  { 2.4999999999999994e-05, -2.4999999999999994e-05 },
+  { 0.000005, -0.000005 },
+  { 0.000015, -0.000025 },
+  { 1.234565, -1.234565 },
+  { 90, -180 },
+  { -90, 180 },
+  { 1e-9, -1e-9 },
+  { 0, 0 },
+  { 37.33415, -122.078384 }
+}};
+constexpr auto encodedRounding = POLYLINE_ENCODE (roundingCoords);
+constexpr auto decodedRounding = POLYLINE_DECODE (encodedRounding.data ());
+
+/* A string with an incomplete final coordinate, which isn't decoded, and
+   an empty one. */
+constexpr auto decodedIncomplete = POLYLINE_DECODE ("_p~iF~ps|U_ulL");
+constexpr auto decodedEmpty = POLYLINE_DECODE ("");
+
+template <std::size_t N>
+static void checkEncode (const std::array<Coordinate, N> &coords,
+                         const char *encoded, const char *name)
+{
+  char *expected = copyEncodedLocationsString (coords.data (), N);
+  CHECK (expected && !std::strcmp (encoded, expected),
+         "POLYLINE_ENCODE (%s) gives %s not %s", name, encoded, expected);
+  std::free (expected);
+}
+
+template <std::size_t N>
+static void checkDecode (const std::array<Coordinate, N> &decoded,
+                         const char *encoded)
+{
+  std::size_t count = 0;
+  Coordinate *expected = decodeLocationsString (encoded, &count);
+  CHECK (count == N, "POLYLINE_DECODE (\"%s\") gives %zu coordinates not %zu",
+         encoded, N, count);
+  for (std::size_t i = 0; i < N && i < count; ++i) {
+    CHECK (decoded[i].latitude == expected[i].latitude
+           && decoded[i].longitude == expected[i].longitude,
+           "POLYLINE_DECODE (\"%s\") coordinate %zu differs", encoded, i);
+  }
+
+  std::free (expected);
+}
+
+static void testRuntimeDecodeThrows ()
+{
+  /* A latitude of 13 characters, longer than any coordinate can be. */
+  const char *tooLong = "_p~iF~ps|U~~~~~~~~~~~~?~ps|U";
+  bool threw = false;
+  try {
+    polyline::decode<2> (tooLong);
+  } catch (const std::invalid_argument &) {
+    threw = true;
+  }
+  CHECK (threw, "a coordinate too long to decode was decoded");
+
+  threw = false;
+  try {
+    polyline::decode<3> ("_p~iF~ps|U_ulLnnqC");
+  } catch (const std::invalid_argument &) {
+    threw = true;
+  }
+  CHECK (threw, "more coordinates were decoded than the string has");
+}
+
+int main ()
+{
+  checkEncode (track, encodedTrack.data (), "track");
+  checkDecode (decodedTrack, encodedTrack.data ());
+  checkEncode (roundingCoords, encodedRounding.data (), "roundingCoords");
+  checkDecode (decodedRounding, encodedRounding.data ());
+  checkDecode (decodedIncomplete, "_p~iF~ps|U_ulL");
+  checkDecode (decodedEmpty, "");
+  testRuntimeDecodeThrows ();
+
+  if (failureCount)
+    std::fprintf (stderr, "%d checks failed\n", failureCount);
+
+  return failureCount ? 1 : 0;
+}
@@ -0,0 +1,1362 @@
+//
+//  polylineTests.c
+//  googlePolylineTestTests
+//
+//  Tests for the C library that don't need Xcode, `make test` in the
+//  PolylineC folder builds and runs them. The checks that fail are printed
+//  and the exit status is 1 if there were any.
+//
+
+/* Needed for pthreads when compiling with -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "AppendableDataStore.h"
+#include "polylineFunctions.h"
+#include "polylineFilter.h"
+#include "polylineDimensions.h"
+#include "polylineEncoderPool.h"
+#include "polylineBatch.h"
+#include "polylineWindow.h"
+#include "polylineCache.h"
+
+static int failureCount;
+
+#define CHECK(condition, ...) \
+  do { \
+    if (!(condition)) { \
+      fprintf (stderr, "%s:%d: ", __func__, __LINE__); \
+      fprintf (stderr, __VA_ARGS__); \
+      fputc ('\n', stderr); \
+      ++failureCount; \
+    } \
+  } while (0)
+
+/* A GPS like track of count points starting in Cupertino, the same seed
+   always gives the same track. Free it with free. */
+static Coordinate *testTrack (size_t count, unsigned seed)
+{
+  Coordinate *coords = malloc (count * sizeof (Coordinate));
+  double lat = 37.33415, lng = -122.078384;
+  for (size_t i = 0; i < count; ++i) {
+    seed = seed * 1103515245 + 12345;
+    lat += ((int)(seed >> 16 & 0x3ff) - 512) * 1e-6;
+    seed = seed * 1103515245 + 12345;
+    lng += ((int)(seed >> 16 & 0x3ff) - 512) * 1e-6;
+    coords[i].latitude = lat;
+    coords[i].longitude = lng;
+  }
+
+  return coords;
+}
+
+static char *encodePoints (const double *latLngs, size_t count)
+{
+  Coordinate coords[16];
+  for (size_t i = 0; i < count; ++i) {
+    coords[i].latitude = latLngs[2 * i];
+    coords[i].longitude = latLngs[2 * i + 1];
+  }
+
+  return copyEncodedLocationsString (coords, count);
+}
+
+static bool filterMatchesPoints (const PolylineFilter *filter,
+                                 const double *latLngs, size_t count)
+{
+  char *encoded = encodePoints (latLngs, count);
+  bool matches = PolylineFilterMatches (filter, encoded);
+  free (encoded);
+  return matches;
+}
+
+static void testFilterBounds (void)
+{
+  PolylineFilter *filter = PolylineFilterCreateWithBounds (1, 1, 2, 2);
+
+  const double inside[] = { 0, 0, 1.5, 1.5, 3, 3 };
+  CHECK (filterMatchesPoints (filter, inside, 3), "Point inside the box");
+
+  const double crossing[] = { 0, 1.5, 3, 1.5 };
+  CHECK (filterMatchesPoints (filter, crossing, 2),
+         "Segment crossing the box");
+
+  const double west[] = { 0, 0, 3, 0 };
+  CHECK (!filterMatchesPoints (filter, west, 2), "Segment west of the box");
+
+  /* Both ends are outside different edges but it passes the corner. */
+  const double corner[] = { 5, 0, 0, 5 };
+  CHECK (!filterMatchesPoints (filter, corner, 2),
+         "Segment passing the corner");
+
+  CHECK (!PolylineFilterMatches (filter, ""), "Empty polyline");
+  CHECK (!PolylineFilterCreateWithBounds (2, 1, 1, 2), "South > north");
+  PolylineFilterFree (filter);
+}
+
+static void testFilterCorridor (void)
+{
+  /* A degree along the equator, about 111km. */
+  const Coordinate corridor[] = { { 0, 0 }, { 0, 1 } };
+  PolylineFilter *filter = PolylineFilterCreateWithCorridor (corridor, 2,
+                                                             1000);
+
+  /* Both points are 11km away but the segment between them crosses. */
+  const double crossing[] = { -0.1, 0.5, 0.1, 0.5 };
+  CHECK (filterMatchesPoints (filter, crossing, 2),
+         "Segment crossing the corridor");
+
+  const double near[] = { 0.5, 1.5, 0.005, 1.005 };
+  CHECK (filterMatchesPoints (filter, near, 2), "Point 790m away");
+
+  /* Passes 560m beyond the end of the corridor. */
+  const double pastEnd[] = { -0.1, 1.005, 0.1, 1.005 };
+  CHECK (filterMatchesPoints (filter, pastEnd, 2),
+         "Segment passing the end of the corridor");
+
+  const double parallel[] = { 0.02, 0.2, 0.02, 0.8 };
+  CHECK (!filterMatchesPoints (filter, parallel, 2),
+         "Segment 2.2km away");
+
+  const double single[] = { 0.005, 0.5 };
+  CHECK (filterMatchesPoints (filter, single, 1), "Single point 560m away");
+  PolylineFilterFree (filter);
+
+  /* A corridor of one point is a circle. */
+  filter = PolylineFilterCreateWithCorridor (corridor, 1, 1000);
+  const double throughCircle[] = { -0.1, 0.005, 0.1, 0.005 };
+  CHECK (filterMatchesPoints (filter, throughCircle, 2),
+         "Segment through the circle");
+  const double missCircle[] = { -0.1, 0.05, 0.1, 0.05 };
+  CHECK (!filterMatchesPoints (filter, missCircle, 2),
+         "Segment missing the circle");
+  PolylineFilterFree (filter);
+
+  CHECK (!PolylineFilterCreateWithCorridor (corridor, 0, 1000),
+         "Empty corridor");
+}
+
+static void testFilterMatchBatch (void)
+{
+  enum { polylineCount = 200, pointCount = 50 };
+  char *encoded[polylineCount];
+  for (unsigned i = 0; i < polylineCount; ++i) {
+    Coordinate *track = testTrack (pointCount, i);
+    encoded[i] = copyEncodedLocationsString (track, pointCount);
+    free (track);
+  }
+
+  PolylineFilter *filter = PolylineFilterCreateWithBounds (37.335, -122.08,
+                                                           37.34, -122.075);
+  size_t serial[polylineCount], threaded[polylineCount];
+  size_t serialCount = PolylineFilterMatchBatch (filter,
+                                                 (const char *const *)encoded,
+                                                 polylineCount, 1, serial);
+  size_t threadedCount = PolylineFilterMatchBatch (filter,
+                                                   (const char *const *)encoded,
+                                                   polylineCount, 7, threaded);
+  CHECK (serialCount > 0 && serialCount < polylineCount,
+         "%zu of the polylines matched", serialCount);
+  CHECK (threadedCount == serialCount
+         && !memcmp (serial, threaded, serialCount * sizeof (size_t)),
+         "Threads matched different polylines");
+
+  for (size_t i = 0, j = 0; i < polylineCount; ++i) {
+    bool matches = j < serialCount && serial[j] == i;
+    CHECK (matches == PolylineFilterMatches (filter, encoded[i]),
+           "Polyline %zu", i);
+    j += matches;
+  }
+
+  PolylineFilterFree (filter);
+  for (unsigned i = 0; i < polylineCount; ++i)
+    free (encoded[i]);
+}
+
+static void testDimensionsRoundTrip (void)
+{
+  enum { pointCount = 300 };
+  /* Latitude, longitude, elevation in cm and a time in ms, then the
+     latitude again at a precision that needs more than 32 bits. */
+  const unsigned precisions[] = { 5, 5, 2, 3, 10 };
+  const unsigned dimensionCount = 5;
+  Coordinate *track = testTrack (pointCount, 1);
+  double lats[pointCount], lngs[pointCount], elevations[pointCount];
+  double times[pointCount];
+  for (size_t i = 0; i < pointCount; ++i) {
+    lats[i] = track[i].latitude;
+    lngs[i] = track[i].longitude;
+    elevations[i] = 20 + sin (i * 0.1) * 15.5;
+    times[i] = 1.6e9 + i * 1.25;
+  }
+  const double *columns[] = { lats, lngs, elevations, times, lats };
+
+  char *encoded = copyEncodedDimensionsString (columns, dimensionCount,
+                                               precisions, pointCount);
+  CHECK (encoded, "Encoding failed");
+
+  /* Encoding a point at a time gives the same string. */
+  PolylineDimensionEncoder *encoder = PolylineDimensionEncoderCreate (dimensionCount,
+                                                                      precisions);
+  char *streamed = malloc ((size_t)pointCount * dimensionCount
+                           * POLYLINE_MAX_CHARS_PER_VALUE + 1);
+  size_t streamedLength = 0;
+  for (size_t i = 0; i < pointCount; ++i) {
+    double values[] = { lats[i], lngs[i], elevations[i], times[i], lats[i] };
+    streamedLength += PolylineDimensionEncoderGetEncodedPoint (encoder, values,
+                                                               streamed + streamedLength);
+  }
+  streamed[streamedLength] = '\0';
+  CHECK (!strcmp (encoded, streamed), "Streamed encoding differs");
+  PolylineDimensionEncoderFree (encoder);
+  free (streamed);
+
+  size_t decodedCount;
+  double *decoded = decodeDimensionsString (encoded, dimensionCount,
+                                            precisions, &decodedCount);
+  CHECK (decodedCount == pointCount, "Decoded %zu points", decodedCount);
+  for (unsigned d = 0; d < dimensionCount && decodedCount == pointCount; ++d) {
+    double scale = pow (10, precisions[d]);
+    for (size_t i = 0; i < pointCount; ++i) {
+      double value = decoded[d * pointCount + i];
+      CHECK (llround (value * scale) == llround (columns[d][i] * scale),
+             "Dimension %u of point %zu is %.10f", d, i, value);
+    }
+  }
+
+  /* A trailing partial point is ignored. */
+  size_t partialCount;
+  encoded[strlen (encoded) - 1] = '\0';
+  free (decodeDimensionsString (encoded, dimensionCount, precisions,
+                                &partialCount));
+  CHECK (partialCount == pointCount - 1, "Decoded %zu points", partialCount);
+
+  CHECK (!copyEncodedDimensionsString (columns, 0, precisions, pointCount),
+         "No dimensions");
+  const unsigned badPrecisions[] = { 5, POLYLINE_MAX_PRECISION + 1 };
+  CHECK (!PolylineDimensionEncoderCreate (2, badPrecisions),
+         "Precision too large");
+
+  free (decoded);
+  free (encoded);
+  free (track);
+}
+
+static void testDimensionsMatchPolyline (void)
+{
+  enum { pointCount = 500 };
+  const unsigned precisions[] = { 5, 5 };
+  Coordinate *track = testTrack (pointCount, 2);
+  /* Jumps that need the longest values, and ones past the table. */
+  track[100].latitude = -89.99999;
+  track[101].longitude = 179.99999;
+  track[200].latitude += 0.01;
+  double lats[pointCount], lngs[pointCount];
+  for (size_t i = 0; i < pointCount; ++i) {
+    lats[i] = track[i].latitude;
+    lngs[i] = track[i].longitude;
+  }
+  const double *columns[] = { lats, lngs };
+
+  char *expected = copyEncodedLocationsString (track, pointCount);
+  char *encoded = copyEncodedDimensionsString (columns, 2, precisions,
+                                               pointCount);
+  CHECK (!strcmp (expected, encoded), "2-D encoding differs from polyline");
+
+  size_t expectedCount, decodedCount;
+  Coordinate *expectedCoords = decodeLocationsString (expected,
+                                                      &expectedCount);
+  double *decoded = decodeDimensionsString (expected, 2, precisions,
+                                            &decodedCount);
+  CHECK (decodedCount == expectedCount, "Decoded %zu points", decodedCount);
+  for (size_t i = 0; i < decodedCount && decodedCount == expectedCount; ++i) {
+    CHECK (decoded[i] == expectedCoords[i].latitude
+           && decoded[decodedCount + i] == expectedCoords[i].longitude,
+           "Point %zu differs", i);
+  }
+
+  free (decoded);
+  free (expectedCoords);
+  free (encoded);
+  free (expected);
+  free (track);
+}
+
+/* Values that aren't finite, or are too large once scaled to be stored
+   as 64 bit differences, are refused rather than converted. */
+static void testDimensionsBadValues (void)
+{
+  const unsigned precisions[] = { 5, 10 };
+  const double badValues[][2] = {
+    { NAN, 0 }, { 0, INFINITY }, { -INFINITY, 0 }, { 1e300, 0 },
+    { 0, 5e8 }, { 0, -4.62e8 }, { 4.7e13, 0 }
+  };
+  const size_t badCount = sizeof (badValues) / sizeof (badValues[0]);
+  const double good[][2] = { { 38.5, -120.2 }, { 1e8, -4.6e8 } };
+
+  PolylineDimensionEncoder *encoder = PolylineDimensionEncoderCreate (2,
+                                                                      precisions);
+  char streamed[3 * 2 * POLYLINE_MAX_CHARS_PER_VALUE + 1];
+  size_t streamedLength = 0;
+  for (size_t i = 0; i < 2; ++i) {
+    unsigned length = PolylineDimensionEncoderGetEncodedPoint (encoder,
+                                                               good[i],
+                                                               streamed
+                                                               + streamedLength);
+    CHECK (length, "good point %zu wasn't encoded", i);
+    streamedLength += length;
+
+    /* A refused point leaves the encoder where it was. */
+    for (size_t j = 0; j < badCount; ++j) {
+      CHECK (!PolylineDimensionEncoderGetEncodedPoint (encoder, badValues[j],
+                                                       streamed
+                                                       + streamedLength),
+             "%g, %g was encoded", badValues[j][0], badValues[j][1]);
+    }
+  }
+  streamed[streamedLength] = '\0';
+  PolylineDimensionEncoderFree (encoder);
+
+  const double lats[] = { good[0][0], good[1][0] };
+  const double lngs[] = { good[0][1], good[1][1] };
+  const double *columns[] = { lats, lngs };
+  char *encoded = copyEncodedDimensionsString (columns, 2, precisions, 2);
+  CHECK (encoded && !strcmp (encoded, streamed),
+         "the points around the refused ones differ");
+
+  size_t decodedCount = 0;
+  double *decoded = decodeDimensionsString (encoded, 2, precisions,
+                                            &decodedCount);
+  CHECK (decodedCount == 2
+         && llround (decoded[1] * 1e5) == llround (good[1][0] * 1e5)
+         && llround (decoded[3] * 1e10) == llround (good[1][1] * 1e10),
+         "the largest values didn't round trip");
+  free (decoded);
+  free (encoded);
+
+  for (size_t j = 0; j < badCount; ++j) {
+    const double badLats[] = { good[0][0], badValues[j][0], good[1][0] };
+    const double badLngs[] = { good[0][1], badValues[j][1], good[1][1] };
+    const double *badColumns[] = { badLats, badLngs };
+    CHECK (!copyEncodedDimensionsString (badColumns, 2, precisions, 3),
+           "a string with %g, %g was encoded", badValues[j][0],
+           badValues[j][1]);
+  }
+}
+
+static void testFixedPointArguments (void)
+{
+  const int32_t e7Coords[] = { 385000000, -1202000000, 407000000, -1209500000 };
+  char *expected = copyEncodedFixedPointLocationsString (e7Coords, 2,
+                                                         10000000);
+  CHECK (expected && !strcmp (expected, "_p~iF~ps|U_ulLnnqC"),
+         "E7 encoding gave %s", expected);
+
+  CHECK (!copyEncodedFixedPointLocationsString (e7Coords, 2, 0),
+         "0 units per degree");
+  CHECK (!copyEncodedFixedPointLocationsString (e7Coords, 2, -10000000),
+         "Negative units per degree");
+
+  PolylineEncoder *encoder = PolylineEncoderCreate ();
+  char result[POLYLINE_MAX_COORDINATE_CHARS];
+  CHECK (!PolylineEncoderGetEncodedFixedPointCoordinate (encoder, 1, 1, 0,
+                                                         result),
+         "0 units per degree");
+  CHECK (!PolylineEncoderGetEncodedFixedPointCoordinate (encoder, 1, 1, -1,
+                                                         result),
+         "Negative units per degree");
+  CHECK (!PolylineEncoderGetEncodedFixedPointCoordinate (encoder, 1, 1,
+                                                         10000000, NULL),
+         "NULL result");
+
+  /* The rejected calls didn't move the encoder on. */
+  size_t length = 0;
+  char streamed[2 * POLYLINE_MAX_COORDINATE_CHARS + 1];
+  for (unsigned i = 0; i < 2; ++i)
+    length += PolylineEncoderGetEncodedFixedPointCoordinate (encoder,
+                                                             e7Coords[2 * i],
+                                                             e7Coords[2 * i + 1],
+                                                             10000000,
+                                                             streamed + length);
+  streamed[length] = '\0';
+  CHECK (!strcmp (streamed, expected), "Streamed E7 encoding gave %s",
+         streamed);
+
+  PolylineEncoderFree (encoder);
+  free (expected);
+}
+
+/* Coordinates outside -90 to 90 and -180 to 180 would take more than
+   POLYLINE_MAX_COORDINATE_CHARS, or not fit an int32_t, so they're
+   rejected by every encoder. */
+static void testEncodeOutOfRange (void)
+{
+  const Coordinate farOut[] = { { -10000, 10000 }, { 10000, -10000 } };
+  CHECK (!copyEncodedLocationsString (farOut, 2),
+         "coordinates of 10000 degrees were encoded");
+
+  const Coordinate justOut[][1] = { { { 90.000001, 0 } },
+                                    { { 0, -180.000001 } },
+                                    { { NAN, 0 } },
+                                    { { 0, INFINITY } },
+                                    { { 1e10, 1e10 } } };
+  for (size_t i = 0; i < sizeof (justOut) / sizeof (justOut[0]); ++i) {
+    CHECK (!copyEncodedLocationsString (justOut[i], 1),
+           "%f, %f was encoded", justOut[i][0].latitude,
+           justOut[i][0].longitude);
+  }
+
+  /* The extremes take the most characters, which still fit. */
+  const Coordinate extremes[] = { { 90, 180 }, { -90, -180 }, { 90, 180 } };
+  char *encoded = copyEncodedLocationsString (extremes, 3);
+  size_t count = 0;
+  Coordinate *decoded = encoded ? decodeLocationsString (encoded, &count)
+                                : NULL;
+  CHECK (encoded && strlen (encoded) <= 3 * POLYLINE_MAX_COORDINATE_CHARS,
+         "the extremes gave %s", encoded);
+  CHECK (count == 3 && fabs (decoded[1].latitude + 90) < 1e-9
+         && fabs (decoded[1].longitude + 180) < 1e-9,
+         "the extremes didn't decode back");
+  free (decoded);
+  free (encoded);
+
+  const float floatLatLngs[] = { 45.0f, 1e10f };
+  CHECK (!copyEncodedFloatLocationsString (floatLatLngs, 1),
+         "a float longitude of 1e10 was encoded");
+
+  const int32_t e7LatLngs[] = { 385000000, 1800000001 };
+  CHECK (!copyEncodedFixedPointLocationsString (e7LatLngs, 1, 10000000),
+         "an E7 longitude past 180 was encoded");
+  const int32_t unitLatLngs[] = { INT32_MAX, INT32_MIN };
+  CHECK (!copyEncodedFixedPointLocationsString (unitLatLngs, 1, 1),
+         "%d, %d degrees were encoded", INT32_MAX, INT32_MIN);
+  CHECK (!copyEncodedFixedPointLocationsString (unitLatLngs, 1, 100000),
+         "E5 values past the range were encoded");
+
+  /* A rejected coordinate doesn't move the encoder on. */
+  const Coordinate track[] = { { 38.5, -120.2 }, { 40.7, -120.95 } };
+  PolylineEncoder *encoder = PolylineEncoderCreate ();
+  char result[POLYLINE_MAX_COORDINATE_CHARS];
+  char streamed[2 * POLYLINE_MAX_COORDINATE_CHARS + 1];
+  size_t length = PolylineEncoderGetEncodedCoordinate (encoder, track[0],
+                                                       streamed);
+  CHECK (!PolylineEncoderGetEncodedCoordinate (encoder, farOut[0], result),
+         "an out of range coordinate was encoded");
+  CHECK (!PolylineEncoderGetEncodedFixedPointCoordinate (encoder, 0,
+                                                         INT32_MAX, 1,
+                                                         result),
+         "an out of range fixed point coordinate was encoded");
+  length += PolylineEncoderGetEncodedCoordinate (encoder, track[1],
+                                                 streamed + length);
+  streamed[length] = '\0';
+  CHECK (!strcmp (streamed, "_p~iF~ps|U_ulLnnqC"),
+         "streaming around a rejected coordinate gave %s", streamed);
+  PolylineEncoderFree (encoder);
+
+  /* The coordinates before a rejected one are still encoded. */
+  const Coordinate withBad[] = { track[0], track[1], farOut[1], track[0] };
+  encoder = PolylineEncoderCreate ();
+  CHECK (PolylineEncoderEncodeCoordintates (encoder, withBad, 4)
+         == PolylineStatusInvalidArgument,
+         "encoding an out of range coordinate succeeded");
+  CHECK (PolylineEncoderEncodeCoordinate (encoder, farOut[0])
+         == PolylineStatusInvalidArgument,
+         "encoding an out of range coordinate succeeded");
+  encoded = PolylineEncoderCopyEncodedString (encoder);
+  CHECK (encoded && !strcmp (encoded, "_p~iF~ps|U_ulLnnqC"),
+         "the encoder holds %s", encoded);
+  free (encoded);
+  PolylineEncoderFree (encoder);
+}
+
+static void encodeTrack (PolylineEncoder *encoder, const Coordinate *coords,
+                         size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+    PolylineEncoderEncodeCoordinate (encoder, coords[i]);
+}
+
+static void testEncoderReset (void)
+{
+  enum { pointCount = 1000 };
+  Coordinate *track = testTrack (pointCount, 3);
+  char *expected = copyEncodedLocationsString (track, pointCount);
+  size_t expectedLength = strlen (expected);
+
+  PolylineEncoder *encoder = PolylineEncoderCreate ();
+  encodeTrack (encoder, track, pointCount);
+  size_t nodeCount = (expectedLength + 1023) / 1024;
+  CHECK (nodeCount >= 3, "The track only needs %zu nodes", nodeCount);
+  CHECK (PolylineEncoderRetainedBytes (encoder) == nodeCount * 1024,
+         "%zu bytes held", PolylineEncoderRetainedBytes (encoder));
+
+  /* Less than a node still keeps one. */
+  PolylineEncoderReset (encoder, 100);
+  CHECK (PolylineEncoderRetainedBytes (encoder) == 1024,
+         "%zu bytes kept", PolylineEncoderRetainedBytes (encoder));
+  CHECK (PolylineEncoderEncodedStringLength (encoder) == 0,
+         "Reset didn't empty the encoder");
+
+  /* The encoder starts from 0, 0 again and reuses the kept node. */
+  encodeTrack (encoder, track, pointCount);
+  char *encoded = PolylineEncoderCopyEncodedString (encoder);
+  CHECK (!strcmp (encoded, expected), "Encoding after a reset differs");
+  free (encoded);
+
+  PolylineEncoderReset (encoder, 2049);
+  CHECK (PolylineEncoderRetainedBytes (encoder) == 3 * 1024,
+         "%zu bytes kept", PolylineEncoderRetainedBytes (encoder));
+
+  /* A smaller limit also drops the nodes kept by the last reset. */
+  PolylineEncoderReset (encoder, 1024);
+  CHECK (PolylineEncoderRetainedBytes (encoder) == 1024,
+         "%zu bytes kept", PolylineEncoderRetainedBytes (encoder));
+
+  encodeTrack (encoder, track, pointCount);
+  PolylineEncoderReset (encoder, 0);
+  CHECK (PolylineEncoderRetainedBytes (encoder) == 0,
+         "%zu bytes kept", PolylineEncoderRetainedBytes (encoder));
+  encodeTrack (encoder, track, pointCount);
+  encoded = PolylineEncoderCopyEncodedString (encoder);
+  CHECK (!strcmp (encoded, expected), "Encoding after freeing differs");
+  free (encoded);
+
+  PolylineEncoderFree (encoder);
+  free (expected);
+  free (track);
+}
+
+static void *acquireFromPool (void *info)
+{
+  return PolylineEncoderPoolAcquire (info);
+}
+
+static void testEncoderPool (void)
+{
+  enum { acquireCount = 6 };
+  PolylineEncoderPool *pool = PolylineEncoderPoolCreate (1, 4096);
+  PolylineEncoderPoolStats stats;
+
+  PolylineEncoder *encoder = PolylineEncoderPoolAcquire (pool);
+  stats = PolylineEncoderPoolGetStats (pool);
+  CHECK (stats.misses == 1 && stats.hits == 0, "An empty pool hit");
+
+  /* The thread gets back the encoder it released, reset. */
+  Coordinate coord = { 38.5, -120.2 };
+  PolylineEncoderEncodeCoordinate (encoder, coord);
+  PolylineEncoderPoolRelease (pool, encoder);
+  PolylineEncoder *reused = PolylineEncoderPoolAcquire (pool);
+  stats = PolylineEncoderPoolGetStats (pool);
+  CHECK (reused == encoder, "The thread cache wasn't used");
+  CHECK (stats.hits == 1 && stats.misses == 1, "Reuse wasn't a hit");
+  CHECK (PolylineEncoderEncodedStringLength (reused) == 0,
+         "The released encoder wasn't reset");
+  CHECK (PolylineEncoderRetainedBytes (reused) == 1024,
+         "The released encoder didn't keep its node");
+  PolylineEncoderPoolRelease (pool, reused);
+
+  /* Releasing 6 fills the thread cache's 4, the shared pool's 1 and
+     discards the last. */
+  PolylineEncoder *encoders[acquireCount];
+  for (unsigned i = 0; i < acquireCount; ++i)
+    encoders[i] = PolylineEncoderPoolAcquire (pool);
+  for (unsigned i = 0; i < acquireCount; ++i)
+    PolylineEncoderPoolRelease (pool, encoders[i]);
+
+  stats = PolylineEncoderPoolGetStats (pool);
+  CHECK (stats.hits == 2 && stats.misses == 6 && stats.discards == 1,
+         "%zu hits, %zu misses, %zu discards", stats.hits, stats.misses,
+         stats.discards);
+
+  /* Another thread has an empty cache, so takes the shared encoder and
+     then misses. */
+  for (unsigned i = 0; i < 2; ++i) {
+    pthread_t thread;
+    void *acquired;
+    pthread_create (&thread, NULL, acquireFromPool, pool);
+    pthread_join (thread, &acquired);
+    CHECK (acquired, "The thread couldn't acquire an encoder");
+    PolylineEncoderFree (acquired);
+  }
+
+  stats = PolylineEncoderPoolGetStats (pool);
+  CHECK (stats.hits == 3 && stats.misses == 7,
+         "%zu hits, %zu misses after the threads", stats.hits, stats.misses);
+
+  PolylineEncoderPoolFree (pool);
+}
+
+/* Every polyline decoded by the batch must match decodeLocationsString,
+   with one thread and several. */
+static void checkBatchMatchesDecode (const char *const *encodedStrings,
+                                     size_t polylineCount,
+                                     unsigned threadCount)
+{
+  size_t *offsets = malloc ((polylineCount + 1) * sizeof (size_t));
+  size_t coordCount = PolylineBatchCountCoordinates (encodedStrings,
+                                                     polylineCount,
+                                                     threadCount, offsets);
+  double *latitudes = malloc ((coordCount + 1) * sizeof (double));
+  double *longitudes = malloc ((coordCount + 1) * sizeof (double));
+  PolylineStatus status = PolylineBatchDecodeInto (encodedStrings,
+                                                   polylineCount, offsets,
+                                                   threadCount, latitudes,
+                                                   longitudes);
+
+  bool anyMalformed = false;
+  for (size_t i = 0; i < polylineCount; ++i) {
+    size_t count = 0;
+    Coordinate *coords = decodeLocationsString (encodedStrings[i], &count);
+    size_t batchCount = offsets[i + 1] - offsets[i];
+    if (!coords && batchCount) {
+      /* decodeLocationsString rejected it, the batch must too. */
+      anyMalformed = true;
+      CHECK (isnan (latitudes[offsets[i]]) && isnan (longitudes[offsets[i]]),
+             "malformed polyline %zu decoded by the batch", i);
+      continue;
+    }
+
+    CHECK (count == batchCount, "polyline %zu has %zu coordinates, not %zu",
+           i, batchCount, count);
+    for (size_t j = 0; j < count && j < batchCount; ++j) {
+      CHECK (latitudes[offsets[i] + j] == coords[j].latitude
+             && longitudes[offsets[i] + j] == coords[j].longitude,
+             "polyline %zu coordinate %zu differs with %u threads", i, j,
+             threadCount);
+    }
+
+    free (coords);
+  }
+
+  CHECK (status == (anyMalformed ? PolylineStatusMalformedInput
+                                 : PolylineStatusSuccess),
+         "batch status %d with %u threads", status, threadCount);
+
+  PolylineStatus batchStatus = PolylineStatusSuccess;
+  PolylineBatch *batch = PolylineBatchDecode (encodedStrings, polylineCount,
+                                              threadCount, &batchStatus);
+  CHECK (batchStatus == status && !batch == anyMalformed,
+         "PolylineBatchDecode status %d", batchStatus);
+  PolylineBatchFree (batch);
+
+  free (longitudes);
+  free (latitudes);
+  free (offsets);
+}
+
+static void testBatchMatchesDecode (void)
+{
+  enum { polylineCount = 40 };
+  char *encodedStrings[polylineCount + 1];
+  for (size_t i = 0; i < polylineCount; ++i) {
+    /* Some longer than a block of the batch decoding. */
+    size_t count = i % 7 ? i * 13 : 2500 + i;
+    Coordinate *coords = testTrack (count, (unsigned)i + 1);
+    encodedStrings[i] = count ? copyEncodedLocationsString (coords, count)
+                              : strdup ("");
+    free (coords);
+  }
+
+  checkBatchMatchesDecode ((const char *const *)encodedStrings,
+                           polylineCount, 1);
+  checkBatchMatchesDecode ((const char *const *)encodedStrings,
+                           polylineCount, 4);
+
+  /* A latitude of 13 characters, longer than any coordinate can be,
+     followed by more coordinates. */
+  encodedStrings[polylineCount] = strdup ("_p~iF~ps|U" "~~~~~~~~~~~~?"
+                                          "~ps|U_ulLnnqC");
+  checkBatchMatchesDecode ((const char *const *)encodedStrings,
+                           polylineCount + 1, 1);
+  checkBatchMatchesDecode ((const char *const *)encodedStrings,
+                           polylineCount + 1, 4);
+
+  size_t count = 0;
+  CHECK (!decodeLocationsString (encodedStrings[polylineCount], &count),
+         "the malformed polyline was decoded");
+
+  for (size_t i = 0; i <= polylineCount; ++i)
+    free (encodedStrings[i]);
+}
+
+/* The window's polyline must be the same as encoding its last count
+   points of coords from scratch. */
+static bool windowMatches (const PolylineWindow *window,
+                           const Coordinate *coords, size_t end)
+{
+  size_t count = PolylineWindowPointCount (window);
+  char *expected = count ? copyEncodedLocationsString (coords + end - count,
+                                                       count)
+                         : strdup ("");
+  char *encoded = PolylineWindowCopyEncodedString (window);
+  bool matches = encoded && expected && !strcmp (encoded, expected)
+                 && PolylineWindowEncodedLength (window) == strlen (expected);
+  free (encoded);
+  free (expected);
+  return matches;
+}
+
+/* A track with a jump every so often, so the differences take from 2 to
+   12 characters. */
+static Coordinate *jumpyTrack (size_t count, unsigned seed)
+{
+  Coordinate *coords = testTrack (count, seed);
+  for (size_t i = 0; i < count; ++i) {
+    if (i % 37 == 5)
+      coords[i].latitude -= 50;
+    if (i % 53 == 7)
+      coords[i].longitude += 170;
+  }
+
+  return coords;
+}
+
+static void testWindowPointEviction (void)
+{
+  enum { pointCount = 2000, pointCapacity = 50 };
+  Coordinate *coords = jumpyTrack (pointCount, 11);
+  PolylineWindow *window = PolylineWindowCreate (pointCapacity, 0);
+  CHECK (window, "couldn't create the window");
+  CHECK (windowMatches (window, coords, 0), "the empty window isn't empty");
+
+  /* Many times round the ring buffer. */
+  for (size_t i = 0; i < pointCount; ++i) {
+    PolylineWindowAppend (window, coords[i]);
+    size_t expectedCount = i + 1 < pointCapacity ? i + 1 : pointCapacity;
+    CHECK (PolylineWindowPointCount (window) == expectedCount,
+           "%zu points after %zu appends", PolylineWindowPointCount (window),
+           i + 1);
+    CHECK (windowMatches (window, coords, i + 1),
+           "the window differs after %zu appends", i + 1);
+  }
+
+  CHECK (PolylineWindowRemoveOldest (window, 10) == 10,
+         "didn't remove 10 points");
+  CHECK (PolylineWindowPointCount (window) == pointCapacity - 10,
+         "%zu points after removing 10", PolylineWindowPointCount (window));
+  CHECK (windowMatches (window, coords, pointCount),
+         "the window differs after removing 10 points");
+
+  CHECK (PolylineWindowRemoveOldest (window, pointCapacity)
+         == pointCapacity - 10,
+         "didn't remove the rest of the points");
+  CHECK (windowMatches (window, coords, pointCount),
+         "the window isn't empty after removing every point");
+
+  for (size_t i = 0; i < 20; ++i)
+    PolylineWindowAppend (window, coords[i]);
+
+  CHECK (windowMatches (window, coords, 20),
+         "the window differs after appending to an emptied window");
+  PolylineWindowClear (window);
+  CHECK (PolylineWindowPointCount (window) == 0
+         && PolylineWindowEncodedLength (window) == 0,
+         "the window isn't empty after clearing it");
+
+  PolylineWindowFree (window);
+  free (coords);
+}
+
+/* The characters taken by the differences after the first point. */
+static size_t differencesLength (const Coordinate *coords, size_t count)
+{
+  char *all = copyEncodedLocationsString (coords, count);
+  char *first = copyEncodedLocationsString (coords, 1);
+  size_t length = strlen (all) - strlen (first);
+  free (first);
+  free (all);
+  return length;
+}
+
+static void testWindowByteEviction (void)
+{
+  enum { pointCount = 2000, byteCapacity = 40 };
+  Coordinate *coords = jumpyTrack (pointCount, 12);
+  CHECK (!PolylineWindowMemorySize (10, POLYLINE_MAX_COORDINATE_CHARS - 1),
+         "a byte capacity smaller than a coordinate was accepted");
+
+  /* Two windows sharing one block of memory. */
+  size_t size = PolylineWindowMemorySize (pointCount, byteCapacity);
+  size_t stride = (size + 15) / 16 * 16;
+  char *memory = malloc (2 * stride);
+  PolylineWindow *window = PolylineWindowInit (memory, pointCount,
+                                               byteCapacity);
+  PolylineWindow *other = PolylineWindowInit (memory + stride, 3, 0);
+
+  for (size_t i = 0; i < pointCount; ++i) {
+    PolylineWindowAppend (window, coords[i]);
+    PolylineWindowAppend (other, coords[pointCount - 1 - i]);
+    CHECK (windowMatches (window, coords, i + 1),
+           "the window differs after %zu appends", i + 1);
+
+    /* The differences after the first point fit in byteCapacity, and
+       only as many of the oldest points as needed were dropped. */
+    size_t count = PolylineWindowPointCount (window);
+    CHECK (count && differencesLength (coords + i + 1 - count, count)
+                    <= byteCapacity,
+           "%zu points don't fit after %zu appends", count, i + 1);
+    CHECK (count == i + 1
+           || differencesLength (coords + i - count, count + 1)
+              > byteCapacity,
+           "only %zu points kept after %zu appends", count, i + 1);
+  }
+
+  Coordinate reversed[3];
+  for (size_t i = 0; i < 3; ++i)
+    reversed[i] = coords[2 - i];
+
+  CHECK (windowMatches (other, reversed, 3),
+         "the window sharing the memory differs");
+
+  free (memory);
+  free (coords);
+}
+
+/* Coordinates out of range would take more characters than the window
+   keeps room for, they're refused and the window stays as it was. */
+static void testWindowOutOfRange (void)
+{
+  Coordinate coords[3] = {
+    { 38.5, -120.2 }, { 40.7, -120.95 }, { 43.252, -126.453 }
+  };
+  Coordinate bad[] = {
+    { 1e10, 1e10 }, { 90.000001, 0 }, { 0, -180.000001 }, { NAN, 0 },
+    { 0, INFINITY }, { -1e300, 0 }
+  };
+  PolylineWindow *window = PolylineWindowCreate (10, 0);
+  CHECK (window, "couldn't create the window");
+
+  for (size_t i = 0; i < sizeof (bad) / sizeof (bad[0]); ++i) {
+    CHECK (PolylineWindowAppend (window, bad[i])
+           == PolylineStatusInvalidArgument,
+           "%g, %g was appended to an empty window", bad[i].latitude,
+           bad[i].longitude);
+    CHECK (PolylineWindowPointCount (window) == 0
+           && windowMatches (window, coords, 0),
+           "the empty window changed after appending %g, %g",
+           bad[i].latitude, bad[i].longitude);
+  }
+
+  for (size_t i = 0; i < 3; ++i) {
+    CHECK (PolylineWindowAppend (window, coords[i]) == PolylineStatusSuccess,
+           "coordinate %zu wasn't appended", i);
+    for (size_t j = 0; j < sizeof (bad) / sizeof (bad[0]); ++j) {
+      CHECK (PolylineWindowAppend (window, bad[j])
+             == PolylineStatusInvalidArgument,
+             "%g, %g was appended", bad[j].latitude, bad[j].longitude);
+    }
+
+    CHECK (PolylineWindowPointCount (window) == i + 1
+           && windowMatches (window, coords, i + 1),
+           "the window changed after appending out of range coordinates");
+  }
+
+  /* The extremes are in range. */
+  Coordinate extremes[2] = { { 90, 180 }, { -90, -180 } };
+  PolylineWindowClear (window);
+  for (size_t i = 0; i < 2; ++i) {
+    CHECK (PolylineWindowAppend (window, extremes[i])
+           == PolylineStatusSuccess,
+           "%g, %g wasn't appended", extremes[i].latitude,
+           extremes[i].longitude);
+  }
+
+  CHECK (windowMatches (window, extremes, 2),
+         "the window differs with the extremes");
+  PolylineWindowFree (window);
+}
+
+/* The cache's entry must hold the same coordinates as
+   decodeLocationsString gives. */
+static bool cacheEntryMatches (const PolylineCacheEntry *entry,
+                               const char *encodedString)
+{
+  size_t count = 0, entryCount = 0;
+  Coordinate *coords = decodeLocationsString (encodedString, &count);
+  const Coordinate *entryCoords = PolylineCacheEntryCoordinates (entry,
+                                                                 &entryCount);
+  bool matches = coords && count == entryCount
+                 && !memcmp (coords, entryCoords, count * sizeof (Coordinate));
+  free (coords);
+  return matches;
+}
+
+/* Decodes encodedString and releases the entry, returns whether it was
+   found in the cache. */
+static bool cacheDecodeHits (PolylineCache *cache, const char *encodedString)
+{
+  size_t hits = PolylineCacheGetStats (cache).hits;
+  const PolylineCacheEntry *entry = PolylineCacheDecode (cache, encodedString,
+                                                         strlen (encodedString),
+                                                         NULL);
+  CHECK (entry && cacheEntryMatches (entry, encodedString),
+         "the entry for %s differs", encodedString);
+  PolylineCacheEntryRelease (entry);
+  return PolylineCacheGetStats (cache).hits > hits;
+}
+
+static void testCache (void)
+{
+  /* Polylines of the same length so their entries are the same size. */
+  enum { polylineCount = 5 };
+  char *encodedStrings[polylineCount];
+  size_t found = 0;
+  for (unsigned seed = 1; found < polylineCount; ++seed) {
+    Coordinate *coords = testTrack (10, seed);
+    char *encoded = copyEncodedLocationsString (coords, 10);
+    free (coords);
+    if (found && strlen (encoded) != strlen (encodedStrings[0]))
+      free (encoded);
+    else
+      encodedStrings[found++] = encoded;
+  }
+
+  PolylineCache *cache = PolylineCacheCreate (1 << 20, 1);
+  PolylineStatus status = PolylineStatusSuccess;
+  size_t length = strlen (encodedStrings[0]);
+  const PolylineCacheEntry *first = PolylineCacheDecode (cache,
+                                                         encodedStrings[0],
+                                                         length, &status);
+  const PolylineCacheEntry *second = PolylineCacheDecode (cache,
+                                                          encodedStrings[0],
+                                                          length, &status);
+  PolylineCacheStats stats = PolylineCacheGetStats (cache);
+  CHECK (first && first == second && cacheEntryMatches (first,
+                                                        encodedStrings[0]),
+         "a hit didn't give the entry from the miss");
+  CHECK (stats.hits == 1 && stats.misses == 1 && stats.entryCount == 1,
+         "%zu hits and %zu misses for one polyline decoded twice",
+         stats.hits, stats.misses);
+  size_t entrySize = stats.byteCount;
+  PolylineCacheEntryRelease (second);
+  PolylineCacheEntryRelease (first);
+
+  CHECK (!PolylineCacheDecode (cache, "_p~iF~ps|U~~~~~~~~~~~~?~ps|U_ulLnnqC",
+                               36, &status)
+         && status == PolylineStatusMalformedInput,
+         "a malformed polyline was decoded, status %d", status);
+  PolylineCacheFree (cache);
+
+  /* Room for three entries in a single shard, so the least recently used
+     is always the one evicted. */
+  cache = PolylineCacheCreate (3 * entrySize, 1);
+  CHECK (!cacheDecodeHits (cache, encodedStrings[0]), "0 was a hit");
+  CHECK (!cacheDecodeHits (cache, encodedStrings[1]), "1 was a hit");
+  CHECK (!cacheDecodeHits (cache, encodedStrings[2]), "2 was a hit");
+  /* 0 is now newer than 1, so adding 3 evicts 1. */
+  CHECK (cacheDecodeHits (cache, encodedStrings[0]), "0 was a miss");
+  CHECK (!cacheDecodeHits (cache, encodedStrings[3]), "3 was a hit");
+  stats = PolylineCacheGetStats (cache);
+  CHECK (stats.evictions == 1 && stats.entryCount == 3
+         && stats.byteCount == 3 * entrySize,
+         "%zu evictions leaving %zu entries", stats.evictions,
+         stats.entryCount);
+  CHECK (cacheDecodeHits (cache, encodedStrings[2]), "2 was evicted");
+  CHECK (cacheDecodeHits (cache, encodedStrings[0]), "0 was evicted");
+  CHECK (cacheDecodeHits (cache, encodedStrings[3]), "3 was evicted");
+  /* Adding 1 back evicts 2, the least recently used now. */
+  CHECK (!cacheDecodeHits (cache, encodedStrings[1]), "1 wasn't evicted");
+  CHECK (!cacheDecodeHits (cache, encodedStrings[2]),
+         "2 wasn't evicted by 1");
+
+  /* An entry that's still held stays valid after it's evicted. */
+  const PolylineCacheEntry *held = PolylineCacheDecode (cache,
+                                                        encodedStrings[4],
+                                                        length, NULL);
+  const PolylineCacheEntry *retained = PolylineCacheEntryRetain (held);
+  size_t evictions = PolylineCacheGetStats (cache).evictions;
+  for (size_t i = 0; i < 4; ++i)
+    cacheDecodeHits (cache, encodedStrings[i]);
+
+  CHECK (PolylineCacheGetStats (cache).evictions >= evictions + 3,
+         "the held entry wasn't evicted");
+  CHECK (!cacheDecodeHits (cache, encodedStrings[4]),
+         "the held entry was still in the cache");
+  PolylineCacheEntryRelease (held);
+  CHECK (retained == held && cacheEntryMatches (retained, encodedStrings[4]),
+         "the evicted entry changed while it was held");
+  PolylineCacheEntryRelease (retained);
+
+  /* Polylines too big for the shard are decoded but not cached. */
+  Coordinate *coords = testTrack (1000, 99);
+  char *large = copyEncodedLocationsString (coords, 1000);
+  const PolylineCacheEntry *entry = PolylineCacheDecode (cache, large,
+                                                         strlen (large), NULL);
+  CHECK (entry && cacheEntryMatches (entry, large),
+         "the polyline too big for the cache wasn't decoded");
+  CHECK (PolylineCacheGetStats (cache).byteCount <= 3 * entrySize,
+         "the polyline too big for the cache was cached");
+  PolylineCacheEntryRelease (entry);
+  free (large);
+  free (coords);
+
+  PolylineCacheFree (cache);
+  for (size_t i = 0; i < polylineCount; ++i)
+    free (encodedStrings[i]);
+}
+
+/* A character outside '?' to '~' anywhere makes a polyline malformed,
+   for every way of decoding it. */
+static void testDecodeBadCharacters (void)
+{
+  const char *badStrings[] = { "_p~iF~ps|U!_ulLnnqC", "_p~iF~ps|U_ulLnnqC\n",
+                               "_p~iF~ps|U_ulLnnqC_mqNvxq`@ ",
+                               "_p~iF~ps|U_ulLnnqC\n_mqNvxq`@" };
+  for (size_t i = 0; i < sizeof (badStrings) / sizeof (badStrings[0]); ++i) {
+    const char *badString = badStrings[i];
+    size_t count = 0;
+    CHECK (!decodeLocationsString (badString, &count) && !count,
+           "string %zu with a bad character was decoded", i);
+
+    PolylineEncoder *encoder = PolylineEncoderCreate ();
+    CHECK (PolylineEncoderDecodeCoordinates (encoder, badString, &count)
+           == PolylineStatusMalformedInput,
+           "string %zu with a bad character wasn't malformed", i);
+    CHECK (count >= 1, "the coordinates before the bad character in string "
+           "%zu weren't decoded", i);
+    PolylineEncoderFree (encoder);
+
+    PolylineStatus status = PolylineStatusSuccess;
+    PolylineCache *cache = PolylineCacheCreate (1 << 20, 1);
+    CHECK (!PolylineCacheDecode (cache, badString, strlen (badString),
+                                 &status)
+           && status == PolylineStatusMalformedInput,
+           "the cache decoded string %zu, status %d", i, status);
+    PolylineCacheFree (cache);
+
+    CHECK (!PolylineBatchDecode (&badString, 1, 1, &status)
+           && status == PolylineStatusMalformedInput,
+           "the batch decoded string %zu, status %d", i, status);
+  }
+
+  /* The bad character arriving in a later chunk, while the characters
+     left over from the first are being decoded. */
+  PolylineEncoder *encoder = PolylineEncoderCreate ();
+  size_t count = 0;
+  PolylineStatus status = PolylineStatusSuccess;
+  Coordinate *coords = PolylineEncoderGetDecodedCoordinates (encoder,
+                                                             "_p~iF~ps|U_ul",
+                                                             &count, &status);
+  CHECK (count == 1 && status == PolylineStatusSuccess,
+         "the first chunk gave %zu coordinates, status %d", count, status);
+  free (coords);
+  coords = PolylineEncoderGetDecodedCoordinates (encoder, "\nLnnqC", &count,
+                                                 &status);
+  CHECK (!count && status == PolylineStatusMalformedInput,
+         "the bad chunk gave %zu coordinates, status %d", count, status);
+  free (coords);
+  PolylineEncoderFree (encoder);
+}
+
+/* Values added a few at a time to nodes of 4, so they're spread over
+   many nodes and some adds cross from one node to the next. */
+static void testDataStoreEnumeration (void)
+{
+  enum { valueCount = 100 };
+  AppendableDataStore *store = AppendableDataStoreCreate (4, sizeof (int));
+  int value;
+  CHECK (!AppendableDataStoreNext (store, &value),
+         "the empty store enumerated a value");
+
+  int values[valueCount];
+  for (int i = 0; i < valueCount; ++i)
+    values[i] = i * 7 - 300;
+
+  for (unsigned added = 0, chunk = 1; added < valueCount; ++chunk) {
+    unsigned count = chunk % 6;
+    if (count > valueCount - added)
+      count = valueCount - added;
+    AppendableDataStoreAddData (store, values + added, count);
+    added += count;
+  }
+
+  CHECK (AppendableDataStoreDataSize (store) == valueCount * sizeof (int),
+         "the store has %zu bytes", AppendableDataStoreDataSize (store));
+
+  /* Stop part way, in the middle of a node, and start again from the
+     first value. */
+  for (int pass = 0; pass < 3; ++pass) {
+    int stop = pass == 2 ? valueCount : 37 + pass * 4;
+    int i = 0;
+    while (i < stop && AppendableDataStoreNext (store, &value)) {
+      CHECK (value == values[i], "pass %d value %d is %d not %d", pass, i,
+             value, values[i]);
+      ++i;
+    }
+
+    CHECK (i == stop, "pass %d enumerated %d values not %d", pass, i, stop);
+    AppendableDataStoreResetEnumeration (store);
+  }
+
+  /* Running off the end keeps returning false. */
+  int count = 0;
+  while (AppendableDataStoreNext (store, &value))
+    ++count;
+  CHECK (count == valueCount, "enumerated %d values not %d", count,
+         valueCount);
+  CHECK (!AppendableDataStoreNext (store, &value),
+         "a value was enumerated after the end");
+
+  /* A reset store enumerates only what's added after it, in the nodes it
+     kept. */
+  AppendableDataStoreReset (store, 2);
+  CHECK (!AppendableDataStoreNext (store, &value),
+         "the reset store enumerated a value");
+  AppendableDataStoreAddData (store, values + 50, 10);
+  for (count = 0; AppendableDataStoreNext (store, &value); ++count) {
+    CHECK (count < 10 && value == values[50 + count],
+           "value %d after the reset is %d", count, value);
+  }
+  CHECK (count == 10, "enumerated %d values after the reset", count);
+
+  AppendableDataStoreFree (store);
+}
+
+/* The cursor must give the same coordinates as decodeLocationsString,
+   however they're read. */
+static void testCursor (void)
+{
+  enum { pointCount = 1000 };
+  Coordinate *coords = jumpyTrack (pointCount, 13);
+  char *encoded = copyEncodedLocationsString (coords, pointCount);
+  size_t length = strlen (encoded);
+  size_t expectedCount;
+  Coordinate *expected = decodeLocationsString (encoded, &expectedCount);
+  CHECK (expectedCount == pointCount, "decoded %zu coordinates",
+         expectedCount);
+
+  PolylineCursor cursor;
+  PolylineCursorInit (&cursor, encoded, length);
+  CHECK (PolylineCursorRemainingBytes (&cursor) == length,
+         "%zu bytes remain before reading",
+         PolylineCursorRemainingBytes (&cursor));
+
+  Coordinate coord;
+  size_t i = 0;
+  for (; i < 10 && PolylineCursorNext (&cursor, &coord); ++i) {
+    CHECK (coord.latitude == expected[i].latitude
+           && coord.longitude == expected[i].longitude,
+           "coordinate %zu from PolylineCursorNext differs", i);
+  }
+
+  CHECK (PolylineCursorSkip (&cursor, 5) == 5, "didn't skip 5 coordinates");
+  i += 5;
+
+  Coordinate buffer[7];
+  size_t count;
+  while ((count = PolylineCursorNextN (&cursor, buffer, 7))) {
+    for (size_t j = 0; j < count && i < expectedCount; ++j, ++i) {
+      CHECK (buffer[j].latitude == expected[i].latitude
+             && buffer[j].longitude == expected[i].longitude,
+             "coordinate %zu from PolylineCursorNextN differs", i);
+    }
+  }
+
+  CHECK (i == expectedCount, "the cursor read %zu coordinates", i);
+  CHECK (PolylineCursorRemainingBytes (&cursor) == 0,
+         "%zu bytes remain after reading",
+         PolylineCursorRemainingBytes (&cursor));
+  CHECK (!PolylineCursorNext (&cursor, &coord)
+         && !PolylineCursorSkip (&cursor, 1), "read past the end");
+
+  /* Skipping more than there are, then an incomplete coordinate at the
+     end and a NUL before the end of the length aren't read. */
+  PolylineCursorInit (&cursor, encoded, length);
+  CHECK (PolylineCursorSkip (&cursor, pointCount + 5) == pointCount,
+         "skipping past the end didn't skip every coordinate");
+
+  PolylineCursorInit (&cursor, "_p~iF~ps|U_ulL", 14);
+  CHECK (PolylineCursorNextN (&cursor, buffer, 7) == 1,
+         "an incomplete coordinate was read");
+  PolylineCursorInit (&cursor, "_p~iF~ps|U\0_ulLnnqC", 19);
+  CHECK (PolylineCursorNextN (&cursor, buffer, 7) == 1,
+         "the cursor read past a NUL");
+
+  free (expected);
+  free (encoded);
+  free (coords);
+}
+
+static bool reportIs (const PolylineDamageReport *report, size_t errorOffset,
+                      size_t validLength, size_t validCount,
+                      size_t damagedValueCount, bool truncated)
+{
+  return report->errorOffset == errorOffset
+         && report->validLength == validLength
+         && report->validCount == validCount
+         && report->damagedValueCount == damagedValueCount
+         && report->truncated == truncated;
+}
+
+/* The same cases as testDamagedDecoding in the Xcode tests, and a few
+   more: damaged characters, a truncated tail and a value that runs on for
+   more than 6 characters, with and without resyncing. */
+static void testDamagedDecoding (void)
+{
+  enum { pointCount = 500 };
+  Coordinate *coords = jumpyTrack (pointCount, 14);
+  char *encoded = copyEncodedLocationsString (coords, pointCount);
+  size_t length = strlen (encoded);
+  size_t expectedCount;
+  Coordinate *expected = decodeLocationsString (encoded, &expectedCount);
+
+  /* An undamaged polyline decodes the same as decodeLocationsString. */
+  size_t count;
+  PolylineDamageReport report;
+  Coordinate *decoded = decodeDamagedLocationsString (encoded, length, false,
+                                                      &count, &report);
+  CHECK (count == expectedCount && decoded
+         && !memcmp (decoded, expected, count * sizeof (Coordinate)),
+         "the undamaged polyline decoded differently");
+  CHECK (reportIs (&report, length, length, count, 0, false),
+         "the undamaged polyline's report is wrong");
+  free (decoded);
+
+  /* A truncated tail, the last coordinate is incomplete and isn't
+     returned. */
+  char *lastCoord = copyEncodedLocationsString (coords, pointCount - 1);
+  size_t validLength = strlen (lastCoord);
+  free (lastCoord);
+  decoded = decodeDamagedLocationsString (encoded, length - 1, false, &count,
+                                          &report);
+  CHECK (count == expectedCount - 1 && decoded
+         && !memcmp (decoded, expected, count * sizeof (Coordinate)),
+         "the truncated polyline decoded %zu coordinates", count);
+  CHECK (reportIs (&report, length - 1, validLength, count, 0, true),
+         "the truncated polyline's report is wrong");
+  free (decoded);
+
+  /* Damage a character in the middle of a value, the ones before it
+     have the continuation bit set. */
+  size_t badOffset = length / 2;
+  while (!((encoded[badOffset] - 63) & 0x20))
+    ++badOffset;
+  encoded[badOffset] = '!';
+
+  Coordinate *prefix = decodeDamagedLocationsString (encoded, length, false,
+                                                     &count, &report);
+  CHECK (report.errorOffset == badOffset, "wrong error offset %zu not %zu",
+         report.errorOffset, badOffset);
+  CHECK (report.damagedValueCount == 1 && count == report.validCount
+         && !report.truncated, "decoded past the damage");
+  CHECK (prefix && !memcmp (prefix, expected, count * sizeof (Coordinate)),
+         "the prefix doesn't match");
+  char *validPart = copyEncodedLocationsString (coords, count);
+  CHECK (report.validLength == strlen (validPart)
+         && report.validLength <= badOffset,
+         "the valid length is %zu", report.validLength);
+  free (validPart);
+
+  Coordinate *resynced = decodeDamagedLocationsString (encoded, length, true,
+                                                       &count, &report);
+  CHECK (count == expectedCount, "resyncing decoded %zu coordinates", count);
+  CHECK (report.errorOffset == badOffset && report.damagedValueCount == 1
+         && !report.truncated, "resyncing gave the wrong report");
+  for (size_t i = 0; i < report.validCount && i < count; ++i) {
+    CHECK (resynced[i].latitude == expected[i].latitude
+           && resynced[i].longitude == expected[i].longitude,
+           "resynced coordinate %zu before the damage differs", i);
+  }
+
+  for (size_t i = report.validCount + 1; i + 1 < count; ++i) {
+    /* The coordinates after the damage are all moved by the same amount. */
+    long latDiff = lround (resynced[i + 1].latitude * 1e5)
+                   - lround (resynced[i].latitude * 1e5);
+    long expectedDiff = lround (expected[i + 1].latitude * 1e5)
+                        - lround (expected[i].latitude * 1e5);
+    CHECK (latDiff == expectedDiff, "wrong shape at coordinate %zu", i);
+  }
+
+  free (prefix);
+  free (resynced);
+
+  /* A second damaged value further on is only counted when resyncing. */
+  size_t secondOffset = badOffset + (length - badOffset) / 2;
+  encoded[secondOffset] = ' ';
+  decoded = decodeDamagedLocationsString (encoded, length, false, &count,
+                                          &report);
+  CHECK (report.errorOffset == badOffset && report.damagedValueCount == 1,
+         "the second damage was seen without resyncing");
+  free (decoded);
+  decoded = decodeDamagedLocationsString (encoded, length, true, &count,
+                                          &report);
+  CHECK (report.errorOffset == badOffset && report.damagedValueCount == 2,
+         "resyncing found %zu damaged values", report.damagedValueCount);
+  free (decoded);
+
+  /* A latitude that runs on for 7 characters, resyncing takes it as a
+     difference of 0 and carries on from the '?' that ends it. A NUL
+     within the length or a new line is damaged in the same way. */
+  const char *tooLong = "_p~iF~ps|U~~~~~~~?nnqC_mqNvxq`@";
+  decoded = decodeDamagedLocationsString (tooLong, strlen (tooLong), false,
+                                          &count, &report);
+  CHECK (count == 1 && decoded && decoded[0].latitude == 38.5
+         && decoded[0].longitude == -120.2,
+         "the value that's too long gave %zu coordinates", count);
+  CHECK (reportIs (&report, 16, 10, 1, 1, false),
+         "the value that's too long has the wrong report");
+  free (decoded);
+  decoded = decodeDamagedLocationsString (tooLong, strlen (tooLong), true,
+                                          &count, &report);
+  CHECK (count == 3 && decoded && decoded[1].latitude == 38.5
+         && decoded[1].longitude == -120.95
+         && lround (decoded[2].longitude * 1e5) == -12645300,
+         "resyncing the value that's too long gave %zu coordinates", count);
+  CHECK (reportIs (&report, 16, 10, 1, 1, false),
+         "resyncing the value that's too long has the wrong report");
+  free (decoded);
+
+  const char *withNul = "_p~iF~ps|U\0ulLnnqC";
+  decoded = decodeDamagedLocationsString (withNul, 19, false, &count,
+                                          &report);
+  CHECK (count == 1 && reportIs (&report, 10, 10, 1, 1, false),
+         "the NUL wasn't damage, %zu coordinates", count);
+  free (decoded);
+  decoded = decodeDamagedLocationsString ("_p~iF~ps|U\n_ulLnnqC", 19, true,
+                                          &count, NULL);
+  CHECK (count == 2 && decoded && decoded[1].latitude == 38.5
+         && decoded[1].longitude == -120.95,
+         "resyncing past a new line gave %zu coordinates", count);
+  free (decoded);
+
+  CHECK (!decodeDamagedLocationsString ("", 0, true, &count, &report)
+         && !count && reportIs (&report, 0, 0, 0, 0, false),
+         "the empty string wasn't empty");
+
+  free (encoded);
+  free (expected);
+  free (coords);
+}
+
+int main (void)
+{
+  testFilterBounds ();
+  testFilterCorridor ();
+  testFilterMatchBatch ();
+  testDimensionsRoundTrip ();
+  testDimensionsMatchPolyline ();
+  testDimensionsBadValues ();
+  testFixedPointArguments ();
+  testEncodeOutOfRange ();
+  testEncoderReset ();
+  testEncoderPool ();
+  testBatchMatchesDecode ();
+  testWindowPointEviction ();
+  testWindowByteEviction ();
+  testWindowOutOfRange ();
+  testCache ();
+  testDecodeBadCharacters ();
+  testDataStoreEnumeration ();
+  testCursor ();
+  testDamagedDecoding ();
+
+  if (failureCount)
+    fprintf (stderr, "%d checks failed\n", failureCount);
+
+  return failureCount ? 1 : 0;
+}